@@ -15,6 +15,11 @@
 #include <getopt.h>
 #include <cmath>
 #include <chrono>
+
+#include "spatial-index.h"
+#include "emst.h"
+#include "route-search.h"
+#include "held-karp.h"
 #define PI 3.1415926535897932384626433832795028841971693993751
 using namespace std;
 typedef tuple<double,unsigned,unsigned> order_tuple;
@@ -41,9 +46,13 @@ struct Points{
   double * y_coords;
   unsigned * demands;
   double *pairwise_dist;
+  double *radius;  // distance of every node from the depot
+  unsigned *by_angle;  // customers sorted by polar angle around the depot
+  double *sorted_angle;  // sorted_angle[i]: polar angle of by_angle[i], in [-PI, PI]
   Points (void);
   unsigned read (string filename);
   void cal_pairwise_distances();
+  void cal_polar_index();
   double L2_dist (unsigned node1, unsigned node2);
   double L2_dist_squared (unsigned node1, unsigned node2);
 };
@@ -53,6 +62,9 @@ Points :: Points () {
   y_coords = nullptr;
   demands = nullptr;
   pairwise_dist = nullptr;
+  radius = nullptr;
+  by_angle = nullptr;
+  sorted_angle = nullptr;
 }
 unsigned Points :: read (string filename) {
   ifstream in(filename);
@@ -104,6 +116,24 @@ void Points :: cal_pairwise_distances() {
     }
   }
 }
+// Customers by angle around the depot, so that a cone at the depot is one or two contiguous
+// ranges of by_angle. O(n log n), once per instance.
+void Points :: cal_polar_index() {
+  radius = (double*) malloc(sizeof(double) * dimension);
+  by_angle = (unsigned*) malloc(sizeof(unsigned) * (dimension-1));
+  sorted_angle = (double*) malloc(sizeof(double) * (dimension-1));
+  vector<pair<double, unsigned> > vec (dimension-1);
+  radius[0] = 0.0;
+  for(unsigned v=1; v < dimension; ++v) {
+    radius[v] = sqrt((x_coords[v] * x_coords[v]) + (y_coords[v] * y_coords[v]));
+    vec[v-1] = make_pair(atan2(y_coords[v], x_coords[v]), v);
+  }
+  sort(vec.begin(), vec.end());
+  for(unsigned i=0; i < dimension-1; ++i) {
+    sorted_angle[i] = vec[i].first;
+    by_angle[i] = vec[i].second;
+  }
+}
 bool compare_tuple1 (const order_tuple &lhs, const order_tuple &rhs){
   bool result = (get<0>(lhs) < get<0>(rhs)) || ((get<0>(lhs) == get<0>(rhs) && (get<1>(lhs) > get<1>(rhs))));
   return result;
@@ -194,6 +224,11 @@ void tsp_approx (unsigned* cities, unsigned* tour, Points& points, unsigned ncit
   for (i=1; i < ncities; i++)
     tour[i]=cities[i-1];
   tour[0] = cities[ncities-1];
+  if (ncities >= NN_TOUR_MIN_KD) {
+    nearest_neighbour_reorder(tour, ncities, [&points](unsigned v) { return points.x_coords[v]; },
+                              [&points](unsigned v) { return points.y_coords[v]; });
+    return;
+  }
   for (i=1; i < ncities; i++) {
     double ThisX = points.x_coords[tour[i-1]];
     double ThisY = points.y_coords[tour[i-1]];
@@ -215,153 +250,247 @@ void tsp_approx (unsigned* cities, unsigned* tour, Points& points, unsigned ncit
     tour[ClosePt] = temp;
   }
 }
-vector<unsigned> single_tsp_approx (vector<unsigned>& route, Points& points) {
-  unsigned sz = route.size();
-  unsigned* cities = (unsigned*) malloc(sizeof(unsigned) * (sz+1));
-  unsigned* tour = (unsigned*) malloc(sizeof(unsigned) * (sz+1));
-  for(unsigned j = 0; j < sz; ++j)
-    cities[j] = route[j];
-  cities[sz] = 0;
-  tsp_approx (cities, tour, points, sz+1);
-  vector<unsigned> curr_route;
-  for(unsigned kk = 1; kk < sz+1; ++kk) {
-    curr_route.push_back(tour[kk]);
-  }
-  return curr_route;
-}
-void tsp_2opt (unsigned* cities, unsigned* tour, Points& points, unsigned ncities) {
-#if 1
-  unsigned* cities_working_copy = (unsigned*) malloc(sizeof(unsigned) * (ncities+2));
-  cities_working_copy[0] = 0;
-  cities_working_copy[ncities+1] = 0;
-  for (unsigned i = 0; i < ncities; ++i) {
-    cities_working_copy[i+1] = cities[i];
+// Scratch of improve_around_customer, kept by the route under construction so that its neighbourhood
+// search allocates nothing
+struct PolishBuffers {
+  vector<unsigned> id, tour, at, pending;
+  vector<double> len, near;
+};
+// Polish after the customer at position v_pos joined curr_route. A route of up to POLISH_EXACT_MAX_LEN
+// customers is reordered exactly (held_karp is O(2^n n^2) and runs after every insertion, so the
+// bound is below HELD_KARP_MAX_LEN). A longer one gets 2-opt and Or-opt restricted to the
+// neighbourhood of the change: for a node u, the best 2-opt move that removes one of the two edges
+// at u, or the best Or-opt move of a segment of 1..3 customers holding u, in either orientation.
+// It starts from v; every applied move queues the customers at its new edges. edge_len is the
+// length of the edge leaving every position, the last one to the depot; removed edges are priced
+// from it and it is kept up to date. Examining a node costs O(route) and at most IMPROVE_MAX_NODES
+// are examined, so a call is O(route) and building a route of n customers O(n^2).
+// Returns whether the route changed.
+const unsigned POLISH_EXACT_MAX_LEN = 10;
+static_assert(POLISH_EXACT_MAX_LEN <= HELD_KARP_MAX_LEN, "held_karp takes the short routes");
+const unsigned IMPROVE_MAX_NODES = 32;
+const unsigned OR_OPT_MAX_LEN = 3;
+bool improve_around_customer (vector<unsigned>& curr_route, vector<double>& edge_len, Points& points, unsigned v_pos, PolishBuffers& buf) {
+  unsigned n = curr_route.size();
+  if (n < 3) return false;
+  if (n <= POLISH_EXACT_MAX_LEN) {
+    if (held_karp(curr_route.data(), n, 0u, [&points](unsigned a, unsigned b) { return points.L2_dist(a, b); }) == 0.0)  // kept as it was
+      return false;
+    for(unsigned p = 0; p < n; ++p)
+      edge_len[p] = points.L2_dist(curr_route[p], p+1 < n ? curr_route[p+1] : 0);
+    return true;
   }
-  unsigned improve = 0;
-  double minchange;
-  while ( improve < 1)
-  {
-    minchange = 0;
-    unsigned mini, minj;
-    for ( unsigned i = 0; i < ncities; i++ )
-    {
-      minchange += points.L2_dist(cities_working_copy[i], cities_working_copy[i+1]);
-      for ( unsigned j = i + 2; j < ncities+1; j++)
-      {
-        double change = points.L2_dist(cities_working_copy[i], cities_working_copy[j]) + points.L2_dist(cities_working_copy[i+1], cities_working_copy[j+1]) - points.L2_dist(cities_working_copy[j], cities_working_copy[j+1]);
-        if (minchange - change > 0.000001 ) {
-          minchange = change;
-          mini = i;
-          minj = j;
+  // Customers by their slot k = 1..n in curr_route; 0 and n+1 are the depot at both ends.
+  vector<unsigned>& id = buf.id;
+  vector<unsigned>& tour = buf.tour;  // tour[p]: slot at position p
+  vector<unsigned>& at = buf.at;      // at[k]: position of slot k
+  vector<double>& len = buf.len;      // len[p]: edge from position p to p+1
+  id.resize(n+2);
+  tour.resize(n+2);
+  at.resize(n+2);
+  len.resize(n+1);
+  id[0] = id[n+1] = 0;
+  copy(curr_route.begin(), curr_route.end(), id.begin()+1);
+  for(unsigned p = 0; p < n+2; ++p)
+    tour[p] = at[p] = p;
+  len[0] = points.L2_dist(0, curr_route[0]);
+  copy(edge_len.begin(), edge_len.end(), len.begin()+1);
+  auto dist = [&](unsigned p, unsigned q) { return points.L2_dist(id[tour[p]], id[tour[q]]); };
+  vector<unsigned>& pending = buf.pending;
+  pending.assign(1, v_pos + 1);
+  bool changed = false;
+  for(unsigned examined = 0; !pending.empty() && examined < IMPROVE_MAX_NODES; ++examined) {
+    unsigned u = pending.back();
+    pending.pop_back();
+    unsigned m = at[u];
+    // Every move below prices its new edges from a position within two of m: their distances to
+    // the whole route are looked up once, near(q, p) = dist(q, p) for |q - m| <= 2
+    unsigned w = n+2;
+    buf.near.resize(5*w);
+    for(unsigned q = m > 2 ? m-2 : 0; q <= m+2 && q <= n+1; ++q) {
+      double* row = &buf.near[(q+2-m)*w];
+      for(unsigned p = 0; p < w; ++p)
+        row[p] = dist(q, p);
+    }
+    auto near = [&](unsigned q, unsigned p) { return buf.near[(q+2-m)*w + p]; };
+    double best_gain = 0.000001;
+    unsigned move = 0, best_i = 0, best_j = 0, best_s = 0, best_l = 0;
+    bool best_rev = false;
+    // 2-opt: edges (i, i+1) and (j, j+1), one of them at u, replaced by (i, j) and (i+1, j+1)
+    for(unsigned e : {m-1, m}) {
+      for(unsigned f = 0; f <= n; ++f) {
+        if (f+1 >= e && f <= e+1) continue;
+        unsigned i = min(e, f), j = max(e, f);
+        double gain = len[i] + len[j] - near(e, f) - near(e+1, f+1);
+        if (gain > best_gain) {
+          best_gain = gain;
+          move = 1;
+          best_i = i;
+          best_j = j;
         }
       }
-      minchange -= points.L2_dist(cities_working_copy[i], cities_working_copy[i+1]);
     }
-    improve++;
-    if (minchange < -0.1) {
-      improve = 0;
-      unsigned start = mini+1;
-      unsigned end = minj ;
-      while (start < end) {
-        unsigned to = cities_working_copy[end];
-        cities_working_copy[end] = cities_working_copy[start];
-        cities_working_copy[start] = to;
-        start++;
-        end--;
+    // Or-opt: the segment s..s+l-1 holding u moved between i and i+1, reversed if rev
+    for(unsigned l = 1; l <= OR_OPT_MAX_LEN && l <= n; ++l) {
+      for(unsigned s = m+1 > l ? m+1-l : 1; s <= m && s+l-1 <= n; ++s) {
+        unsigned t = s+l-1;
+        double removed = len[s-1] + len[t] - dist(s-1, t+1);
+        for(unsigned i = 0; i <= n; ++i) {
+          if (i+1 >= s && i <= t) continue;
+          for(bool rev : {false, true}) {
+            if (rev && l == 1) break;
+            double added = rev ? near(t, i) + near(s, i+1) : near(s, i) + near(t, i+1);
+            double gain = removed - (added - len[i]);
+            if (gain > best_gain) {
+              best_gain = gain;
+              move = 2;
+              best_i = i;
+              best_s = s;
+              best_l = l;
+              best_rev = rev;
+            }
+          }
+        }
       }
     }
+    if (move == 0) continue;
+    unsigned touched[4];
+    if (move == 1) {
+      touched[0] = tour[best_i]; touched[1] = tour[best_i+1]; touched[2] = tour[best_j]; touched[3] = tour[best_j+1];
+      reverse(tour.begin() + best_i + 1, tour.begin() + best_j + 1);
+      reverse(len.begin() + best_i + 1, len.begin() + best_j);
+      len[best_i] = dist(best_i, best_i+1);
+      len[best_j] = dist(best_j, best_j+1);
+      for(unsigned p = best_i + 1; p <= best_j; ++p)
+        at[tour[p]] = p;
+    }
+    else {
+      unsigned s = best_s, t = best_s + best_l - 1, lo, hi;  // positions whose slot changed
+      touched[0] = tour[s-1]; touched[1] = tour[t+1]; touched[2] = tour[best_i]; touched[3] = tour[best_i+1];
+      if (best_i < s) {
+        rotate(tour.begin() + best_i + 1, tour.begin() + s, tour.begin() + t + 1);
+        lo = best_i + 1;
+        hi = t;
+        if (best_rev) reverse(tour.begin() + lo, tour.begin() + lo + best_l);
+      }
+      else {
+        rotate(tour.begin() + s, tour.begin() + t + 1, tour.begin() + best_i + 1);
+        lo = s;
+        hi = best_i;
+        if (best_rev) reverse(tour.begin() + hi + 1 - best_l, tour.begin() + hi + 1);
+      }
+      for(unsigned p = lo; p <= hi; ++p)
+        at[tour[p]] = p;
+      for(unsigned p = lo - 1; p <= hi; ++p)
+        len[p] = dist(p, p+1);
+    }
+    pending.push_back(u);
+    for(unsigned w : touched)
+      if (w != 0 && w != n+1 && w != u) pending.push_back(w);
+    changed = true;
   }
-  for (unsigned i=0; i < ncities; ++i) {
-    cities[i] = cities_working_copy[i+1];
+  if (changed) {
+    for(unsigned p = 1; p <= n; ++p)
+      curr_route[p-1] = id[tour[p]];
+    copy(len.begin()+1, len.end(), edge_len.begin());
   }
-#endif
+  return changed;
 }
-vector<unsigned> single_2OPT (vector<unsigned>& route, Points& points) {
-  unsigned sz = route.size();
-  unsigned* cities = (unsigned*) malloc(sizeof(unsigned) * (sz));
-  unsigned* tour = (unsigned*) malloc(sizeof(unsigned) * (sz));
-  for(unsigned j = 0; j < sz; ++j)
-    cities[j] = route[j];
-  vector<unsigned> curr_route;
-  if(sz > 2)
-    tsp_2opt (cities, tour, points, sz);
-  for(unsigned kk = 0; kk < sz; ++kk) {
-    curr_route.push_back(cities[kk]);
+// Insertion cost COST_FUNC of a customer at squared distance dist1 from the node before it and
+// dist2 from the node after it, on an edge of squared length dist_edge_removed. COST_FUNC is a
+// compile-time constant, so the switch folds away. Costs out of range wrap through long long, as
+// the plain (unsigned) casts did on x86-64.
+template <unsigned COST_FUNC>
+inline unsigned get_insertion_cost (double dist1, double dist2, double dist_edge_removed) {
+  double new_increase_in_cost = 0;
+  switch (COST_FUNC) {
+    case 1:
+      new_increase_in_cost = dist1;
+      break;
+    case 2:
+      new_increase_in_cost = dist2;
+      break;
+    case 3:
+      new_increase_in_cost = max(dist1,dist2);
+      break;
+    case 4:
+      new_increase_in_cost = min(dist1,dist2);
+      break;
+    case 5:
+      new_increase_in_cost = dist1 + dist2;
+      break;
+    case 6:
+      new_increase_in_cost = dist1*dist1 + dist2*dist2;
+      break;
+    case 7:
+      new_increase_in_cost = dist1 + dist2 - dist_edge_removed;
+      break;
   }
-  return curr_route;
+  return (unsigned) (long long) new_increase_in_cost;
 }
-double get_best_position_in_route (vector<unsigned> curr_route, Points& points, unsigned& curr_pos, unsigned v) {
-  double min_increase_in_cost = DBL_MAX;
-  unsigned pos;
-  double dist1, dist2, dist_edge_removed;
-  unsigned curr_route_size = curr_route.size();
+// Squared length of the edge leaving every position of a route, the last one to the depot, from
+// their lengths edge_len (L2_dist_squared is the square of L2_dist, so the values are the same)
+void get_route_edges_squared (const vector<double>& edge_len, vector<double>& edge_sq) {
+  edge_sq.resize(edge_len.size());
+  for(unsigned i=0; i < edge_len.size(); ++i)
+    edge_sq[i] = edge_len[i] * edge_len[i];
+}
+// Best position to insert a customer after, from dist_to_v: its squared distance to every node of
+// the route and, last, to the depot. Ties go to the first position.
+template <unsigned COST_FUNC>
+unsigned get_best_position_in_route (const vector<double>& edge_sq, const vector<double>& dist_to_v, unsigned& curr_pos) {
+  unsigned min_increase_in_cost = UINT_MAX;
+  unsigned pos = 0;
+  unsigned curr_route_size = edge_sq.size();
   for(unsigned i=0; i < curr_route_size; ++i) {
-    dist1 = points.L2_dist(curr_route[i], v);
-    if (i == (curr_route_size - 1)) {
-      dist2 = points.L2_dist(0, v);
-      dist_edge_removed = points.L2_dist(0,curr_route[i]);
-    }
-    else {
-      dist2 = points.L2_dist(v, curr_route[i+1]);
-      dist_edge_removed = points.L2_dist(curr_route[i],curr_route[i+1]);
-    }
-    double new_increase_in_cost = dist1 + dist2 - dist_edge_removed;
-    if (new_increase_in_cost < min_increase_in_cost) {
-      min_increase_in_cost = new_increase_in_cost;
-      pos = i;
-    }
+    unsigned new_increase_in_cost = get_insertion_cost<COST_FUNC> (dist_to_v[i], dist_to_v[i+1], edge_sq[i]);
+    pos = new_increase_in_cost < min_increase_in_cost ? i : pos;
+    min_increase_in_cost = min(new_increase_in_cost, min_increase_in_cost);
   }
   curr_pos = pos;
   return min_increase_in_cost;
 }
-unsigned get_best_position_in_route (vector<unsigned> curr_route, Points& points, unsigned& curr_pos, unsigned v, const unsigned cost_func_id ) {
-  unsigned min_increase_in_cost = UINT_MAX;
-  unsigned pos;
-  double dist1, dist2, dist_edge_removed;
-  unsigned curr_route_size = curr_route.size();
-  for(unsigned i=0; i < curr_route_size; ++i) {
-    dist1 = points.L2_dist_squared(curr_route[i], v);
-    if (i == (curr_route_size - 1)) {
-      dist2 = points.L2_dist_squared(0,v);
-      dist_edge_removed = points.L2_dist_squared(0,curr_route[i]);
-    }
-    else {
-      dist2 = points.L2_dist_squared(v,curr_route[i+1]);
-      dist_edge_removed = points.L2_dist_squared(curr_route[i],curr_route[i+1]);
-    }
-    unsigned new_increase_in_cost;
-    switch (cost_func_id) {
-      case 1:
-        new_increase_in_cost = (unsigned) dist1;
-        break;
-      case 2:
-        new_increase_in_cost = (unsigned) dist2;
-        break;
-      case 3:
-        new_increase_in_cost = (unsigned) max(dist1,dist2);
-        break;
-      case 4:
-        new_increase_in_cost = (unsigned) min(dist1,dist2);
-        break;
-      case 5:
-        new_increase_in_cost = (unsigned) (dist1 + dist2);
-        break;
-      case 6:
-        new_increase_in_cost = (unsigned) (dist1*dist1 + dist2*dist2);
-        break;
-      case 7:
-        new_increase_in_cost = (unsigned) (dist1 + dist2 - dist_edge_removed);
-        break;
-    }
-    if (new_increase_in_cost < min_increase_in_cost) {
-      min_increase_in_cost = new_increase_in_cost;
-      pos = i;
+// Customers not yet included that lie in the cone of get_route: between dir_vec2 and dir_vec3,
+// cone_rad either side of dir_vec1 at polar angle angle1. Only the angular range of the cone is
+// scanned; the test itself is the one of the full scan, so the result is the same. Nodes come
+// in their order in shuffled_order (order_rank[v] = position of v), which breaks cost ties.
+void get_nodes_in_cone (Points& points, const unsigned* order_rank, const bool* isIncluded, DirVec& dir_vec1, DirVec& dir_vec2, DirVec& dir_vec3, double angle1, double cone_rad, vector<unsigned>& nodes_in_region) {
+  const unsigned n = points.dimension-1;
+  vector<pair<unsigned, unsigned> > found;  // {rank, node}
+  auto scan = [&](double lo, double hi) {
+    unsigned i = lower_bound(points.sorted_angle, points.sorted_angle + n, lo) - points.sorted_angle;
+    for(; i < n && points.sorted_angle[i] <= hi; ++i) {
+      unsigned p1 = points.by_angle[i];
+      if (isIncluded[p1]) continue;
+      DirVec dir_vec4 ;
+      dir_vec4.x = points.x_coords[p1]/points.radius[p1];
+      dir_vec4.y = points.y_coords[p1]/points.radius[p1];
+      if (isInRegion(dir_vec1, dir_vec2, dir_vec4) || isInRegion(dir_vec1, dir_vec3, dir_vec4))
+        found.push_back(make_pair(order_rank[p1], p1));
     }
+  };
+  const double slack = 1e-9;  // atan2 and the cross products may disagree right at the edges
+  double lo = angle1 - cone_rad - slack;
+  double hi = angle1 + cone_rad + slack;
+  if (hi - lo >= 2*PI)
+    scan(-DBL_MAX, DBL_MAX);
+  else if (lo < -PI) {
+    scan(-DBL_MAX, hi);
+    scan(lo + 2*PI, DBL_MAX);
   }
-  curr_pos = pos;
-  return min_increase_in_cost;
+  else if (hi > PI) {
+    scan(-DBL_MAX, hi - 2*PI);
+    scan(lo, DBL_MAX);
+  }
+  else
+    scan(lo, hi);
+  sort(found.begin(), found.end());
+  nodes_in_region.clear();
+  for(auto& f : found)
+    nodes_in_region.push_back(f.second);
 }
-vector <unsigned> get_route (Points &points, unsigned* node_order, unsigned* shuffled_order, const unsigned capacity, unsigned& num_nodes_included, bool * isIncluded, const unsigned cost_func_id, unsigned cone_angle) {
+template <unsigned COST_FUNC>
+vector <unsigned> get_route (Points &points, unsigned* node_order, const unsigned* order_rank, const unsigned capacity, unsigned& num_nodes_included, bool * isIncluded, unsigned cone_angle) {
   vector<unsigned> curr_route;
   unsigned route_capacity_remaining = capacity;
   for(unsigned i=0; i < points.dimension-1; ++i) {
@@ -396,62 +525,80 @@ vector <unsigned> get_route (Points &points, unsigned* node_order, unsigned* shu
   dir_vec3.x = x_temp / v_magnitude;
   dir_vec3.y = y_temp / v_magnitude;
   vector<unsigned> nodes_in_region;
-  for(unsigned i=0; i < points.dimension-1; ++i) {
-    unsigned p1 = shuffled_order[i];
-    DirVec dir_vec4 ;
-    v_magnitude = sqrt((points.x_coords[p1] * points.x_coords[p1]) + (points.y_coords[p1] * points.y_coords[p1]));
-    dir_vec4.x = points.x_coords[p1]/v_magnitude;
-    dir_vec4.y = points.y_coords[p1]/v_magnitude;
-    bool region_flag1 = isInRegion(dir_vec1, dir_vec2, dir_vec4);
-    bool region_flag2 = isInRegion(dir_vec1, dir_vec3, dir_vec4);
-    if (region_flag1 || region_flag2) {
-      nodes_in_region.push_back(p1);
-    }
-  }
+  get_nodes_in_cone (points, order_rank, isIncluded, dir_vec1, dir_vec2, dir_vec3, atan2(points.y_coords[first_node_of_route], points.x_coords[first_node_of_route]), theta1_rad, nodes_in_region);
+  // Insertion cache: cand_inc[ii] and cand_pos[ii] are what get_best_position_in_route returns for
+  // nodes_in_region[ii] on the current route. An insertion after position p only replaces the edge
+  // leaving p by two edges, so a candidate is rescanned only if its best position was p; otherwise
+  // the two new positions are priced against its cached best. Ties go to the lower position, as in
+  // the full scan. Reoptimising the whole route invalidates the cache.
+  unsigned nodes_in_region_sz = nodes_in_region.size();
+  vector<unsigned> cand_inc (nodes_in_region_sz), cand_pos (nodes_in_region_sz);
+  bool cache_valid = false;
+  vector<double> edge_len (1, points.L2_dist(first_node_of_route, 0));  // as improve_around_customer keeps it
+  vector<double> edge_sq, dist_to_v;
+  PolishBuffers polish;
+  auto best_position = [&](unsigned v, unsigned& pos) {
+    unsigned curr_route_size = curr_route.size();
+    dist_to_v.resize(curr_route_size+1);
+    for(unsigned i=0; i < curr_route_size; ++i)
+      dist_to_v[i] = points.L2_dist_squared(curr_route[i], v);
+    dist_to_v[curr_route_size] = points.L2_dist_squared(0, v);
+    return get_best_position_in_route<COST_FUNC> (edge_sq, dist_to_v, pos);
+  };
   while(true) {
+    if (!cache_valid) get_route_edges_squared (edge_len, edge_sq);
     unsigned least_inc = UINT_MAX;
-    unsigned best_pos;
-    unsigned best_node;
-    unsigned flag = false;
-    unsigned nodes_in_region_sz = nodes_in_region.size();
+    unsigned best_ii = UINT_MAX;  // the first feasible candidate wins even at cost UINT_MAX
     for(unsigned ii=0; ii < nodes_in_region_sz; ++ii) {
       unsigned v = nodes_in_region[ii];
       if(isIncluded[v]) continue;
       if(route_capacity_remaining < points.demands[v]) continue;
-      flag = true;
-      unsigned curr_pos;
-      unsigned curr_inc = get_best_position_in_route (curr_route, points, curr_pos, v, cost_func_id);
-      if (curr_inc < least_inc) {
-        least_inc = curr_inc;
-        best_pos = curr_pos;
-        best_node = v;
+      if (!cache_valid)
+        cand_inc[ii] = best_position (v, cand_pos[ii]);
+      if (best_ii == UINT_MAX || cand_inc[ii] < least_inc) {
+        least_inc = cand_inc[ii];
+        best_ii = ii;
       }
     }
-    if (!flag) break;
+    if (best_ii == UINT_MAX) break;
+    cache_valid = true;
+    unsigned best_pos = cand_pos[best_ii];
+    unsigned best_node = nodes_in_region[best_ii];
     auto it = curr_route.begin() + best_pos + 1;
     curr_route.insert(it,best_node);
     route_capacity_remaining -= points.demands[best_node];
     isIncluded[best_node] = true;
     num_nodes_included += 1;
-    if(curr_route.size() > 2 && curr_route.size() < 30) {
-      vector<unsigned> curr_route1 = single_2OPT(curr_route, points);
-      vector<unsigned> curr_route2 = single_tsp_approx(curr_route, points);
-      vector<unsigned> curr_route3 = single_2OPT(curr_route2, points);
-      double curr_length = get_cost_of_route (curr_route, points);
-      double curr1_length = get_cost_of_route (curr_route1, points);
-      double curr3_length = get_cost_of_route (curr_route3, points);
-      double curr13_length = DBL_MAX;
-      vector<unsigned> curr13_route;
-      if (curr3_length < curr1_length) {
-        curr13_length = curr3_length;
-        curr13_route = curr_route3;
+    unsigned next_node = best_pos + 2 < curr_route.size() ? curr_route[best_pos+2] : 0;
+    edge_len[best_pos] = points.L2_dist(curr_route[best_pos], best_node);
+    edge_len.insert(edge_len.begin() + best_pos + 1, points.L2_dist(best_node, next_node));
+    if (improve_around_customer (curr_route, edge_len, points, best_pos + 1, polish))
+      cache_valid = false;
+    if (!cache_valid) continue;
+    edge_sq[best_pos] = edge_len[best_pos] * edge_len[best_pos];
+    edge_sq.insert(edge_sq.begin() + best_pos + 1, edge_len[best_pos+1] * edge_len[best_pos+1]);
+    for(unsigned ii=0; ii < nodes_in_region_sz; ++ii) {
+      unsigned v = nodes_in_region[ii];
+      if(isIncluded[v]) continue;
+      if(route_capacity_remaining < points.demands[v]) continue;
+      if (cand_pos[ii] == best_pos) {
+        cand_inc[ii] = best_position (v, cand_pos[ii]);
+        continue;
       }
-      else {
-        curr13_length = curr1_length;
-        curr13_route = curr_route1;
+      if (cand_pos[ii] > best_pos) cand_pos[ii] += 1;
+      double dist_prev = points.L2_dist_squared(curr_route[best_pos], v);
+      double dist_new = points.L2_dist_squared(best_node, v);
+      double dist_next = points.L2_dist_squared(next_node, v);
+      unsigned inc1 = get_insertion_cost<COST_FUNC> (dist_prev, dist_new, edge_sq[best_pos]);
+      unsigned inc2 = get_insertion_cost<COST_FUNC> (dist_new, dist_next, edge_sq[best_pos+1]);
+      if (inc1 < cand_inc[ii] || (inc1 == cand_inc[ii] && best_pos < cand_pos[ii])) {
+        cand_inc[ii] = inc1;
+        cand_pos[ii] = best_pos;
+      }
+      if (inc2 < cand_inc[ii] || (inc2 == cand_inc[ii] && best_pos + 1 < cand_pos[ii])) {
+        cand_inc[ii] = inc2;
+        cand_pos[ii] = best_pos + 1;
       }
-      if (curr13_length < curr_length)
-        curr_route = curr13_route;
     }
   }
   return curr_route;
@@ -528,6 +675,8 @@ vector <unsigned> get_route_nearest_neighbor (Points &points, unsigned* node_ord
     isIncluded[closestPt] = true;
     num_nodes_included += 1;
   }
+  vector<double> edge_len (1, points.L2_dist(curr_route[0], 0));  // as improve_around_customer keeps it
+  PolishBuffers polish;
   while(true) {
     unsigned v = curr_route[curr_route.size()-1];
     unsigned closestPt = UINT_MAX;
@@ -551,39 +700,26 @@ vector <unsigned> get_route_nearest_neighbor (Points &points, unsigned* node_ord
     route_capacity_remaining -= points.demands[closestPt];
     isIncluded[closestPt] = true;
     num_nodes_included += 1;
-    if(curr_route.size() > 2 && curr_route.size() < 30) {
-      vector<unsigned> curr_route1 = single_2OPT(curr_route, points);
-      vector<unsigned> curr_route2 = single_tsp_approx(curr_route, points);
-      vector<unsigned> curr_route3 = single_2OPT(curr_route2, points);
-      double curr_length = get_cost_of_route (curr_route, points);
-      double curr1_length = get_cost_of_route (curr_route1, points);
-      double curr3_length = get_cost_of_route (curr_route3, points);
-      double curr13_length = DBL_MAX;
-      vector<unsigned> curr13_route;
-      if (curr3_length < curr1_length) {
-        curr13_length = curr3_length;
-        curr13_route = curr_route3;
-      }
-      else {
-        curr13_length = curr1_length;
-        curr13_route = curr_route1;
-      }
-      if (curr13_length < curr_length)
-        curr_route = curr13_route;
-    }
+    edge_len.back() = points.L2_dist(v, closestPt);
+    edge_len.push_back(points.L2_dist(closestPt, 0));
+    improve_around_customer (curr_route, edge_len, points, curr_route.size() - 1, polish);
   }
   return curr_route;
 }
-void populate_routes (Points& points, unsigned * node_order, unsigned * shuffled_order, unsigned capacity, vector<vector <unsigned> >& final_routes, const unsigned cost_func_id, unsigned cone_angle) {
+template <unsigned COST_FUNC>
+void populate_routes (Points& points, unsigned * node_order, unsigned * shuffled_order, unsigned capacity, vector<vector <unsigned> >& final_routes, unsigned cone_angle) {
   bool* isIncluded = (bool*) malloc(sizeof(bool) * points.dimension);
   memset(isIncluded, 0, sizeof(bool) * (points.dimension));
   isIncluded[0] = true;
+  vector<unsigned> order_rank (points.dimension);
+  for(unsigned i=0; i < points.dimension-1; ++i)
+    order_rank[shuffled_order[i]] = i;
   unsigned num_nodes_included = 1;
   unsigned count = 0;
   unsigned cone_angle1 = cone_angle;
   while (num_nodes_included < points.dimension) {
     if (count > 0 && cone_angle < 85) {cone_angle += 5;}
-    vector<unsigned> curr_route = get_route (points, node_order, shuffled_order, capacity, num_nodes_included, isIncluded, cost_func_id, cone_angle);
+    vector<unsigned> curr_route = get_route<COST_FUNC> (points, node_order, order_rank.data(), capacity, num_nodes_included, isIncluded, cone_angle);
     unsigned sum_of_demands = 0;
     for(unsigned xyz = 0; xyz < curr_route.size(); ++xyz) {
       sum_of_demands += points.demands[curr_route[xyz]];
@@ -600,6 +736,19 @@ void populate_routes (Points& points, unsigned * node_order, unsigned * shuffled
     count = 0;
     cone_angle = cone_angle1;
   }
+  free(isIncluded);
+}
+// The cost function is dispatched once per construction, each one a separate instantiation
+void populate_routes (Points& points, unsigned * node_order, unsigned * shuffled_order, unsigned capacity, vector<vector <unsigned> >& final_routes, const unsigned cost_func_id, unsigned cone_angle) {
+  switch (cost_func_id) {
+    case 1: populate_routes<1> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 2: populate_routes<2> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 3: populate_routes<3> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 4: populate_routes<4> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 5: populate_routes<5> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 6: populate_routes<6> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 7: populate_routes<7> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+  }
 }
 bool verify_sol (vector<vector<unsigned> > final_routes, unsigned capacity, Points &points) {
   unsigned * hist = (unsigned*) malloc(sizeof(unsigned) * points.dimension);
@@ -673,12 +822,11 @@ vector<vector<unsigned> > postprocess_2OPT (vector<vector<unsigned> >& final_rou
   for(unsigned i=0; i < nroutes; ++i ) {
     unsigned sz = final_routes[i].size();
     unsigned* cities = (unsigned*) malloc(sizeof(unsigned) * (sz));
-    unsigned* tour = (unsigned*) malloc(sizeof(unsigned) * (sz));
     for(unsigned j = 0; j < sz; ++j)
       cities[j] = final_routes[i][j];
     vector<unsigned> curr_route;
-    if(sz > 2)
-      tsp_2opt (cities, tour, points, sz);
+    optimise_route(cities, sz, 0u, [&points](unsigned a, unsigned b) { return points.L2_dist(a, b); },
+                   [&points](unsigned v) { return points.x_coords[v]; }, [&points](unsigned v) { return points.y_coords[v]; });
     for(unsigned kk = 0; kk < sz; ++kk) {
       curr_route.push_back(cities[kk]);
     }
@@ -852,37 +1000,9 @@ vector<vector<unsigned> > sci_heuristic (Points& points, unsigned capacity, unsi
   else if (dimension - 1 <= 1500) numIter = 15;
   else if ((dimension - 1 > 1500) && (dimension-1 <= 12000)) numIter = 15;
   else if ((dimension - 1 > 12000) && (dimension-1 < 20000)) numIter = 10;
-  unsigned best_cost_function = UINT_MAX;
-  unsigned best_ordering = UINT_MAX;
+  vector<vector<unsigned> > orderings(numIter);  // orderings[numTry-1]: node ordering of that try
   for(unsigned numTry = 1; numTry <=numIter; ++numTry) {
-    vector<vector <unsigned> > semi_final_routes;
-    double semi_final_total_cost = DBL_MAX;
-    unsigned semi_best_cost_function = UINT_MAX;
-    for(unsigned ii=1; ii <= 7; ++ii) {
-      vector<vector <unsigned> > final_routes_temp;
-      double total_cost_temp = DBL_MAX;
-      for(unsigned kk = 0; kk < theta_vec.size(); ++kk) {
-        vector<vector <unsigned> > final_routes_theta_temp;
-        unsigned ca = theta_vec[kk];
-        populate_routes (points, node_order, shuffled_order, capacity, final_routes_theta_temp, ii, ca);
-        double total_cost_theta_temp = get_total_cost_of_routes (final_routes_theta_temp, points);
-        if(total_cost_theta_temp < total_cost_temp) {
-          total_cost_temp = total_cost_theta_temp;
-          final_routes_temp = final_routes_theta_temp;
-        }
-      }
-      if(total_cost_temp < semi_final_total_cost) {
-        semi_final_total_cost = total_cost_temp;
-        semi_final_routes = final_routes_temp;
-        semi_best_cost_function = ii;
-      }
-    }
-    if(semi_final_total_cost < final_total_cost) {
-      final_total_cost = semi_final_total_cost;
-      final_routes = semi_final_routes;
-      best_cost_function = semi_best_cost_function;
-      best_ordering = numTry;
-    }
+    orderings[numTry-1].assign(shuffled_order, shuffled_order + dimension-1);
     if(numTry == 2) {
       for(unsigned i=0; i < dimension-1; ++i)
         shuffled_order[i] = node_order[dimension-2-i];
@@ -894,6 +1014,40 @@ vector<vector<unsigned> > sci_heuristic (Points& points, unsigned capacity, unsi
     if(numTry >= 4)
       shuffle(shuffled_order, dimension-1);
   }
+  // All (ordering, cost function, cone angle) constructions are independent. Task t is the t-th one
+  // of the serial sweep; ties in cost go to the lowest t, so the winner does not depend on the schedule.
+  const unsigned first_cost_func = 1, num_cost_funcs = 8 - first_cost_func;
+  const unsigned num_angles = theta_vec.size();
+  const unsigned num_tasks = numIter * num_cost_funcs * num_angles;
+  unsigned best_task = UINT_MAX;
+  #pragma omp parallel
+  {
+    vector<vector <unsigned> > local_routes;
+    double local_cost = DBL_MAX;
+    unsigned local_task = UINT_MAX;
+    #pragma omp for schedule(dynamic, 1) nowait
+    for(unsigned t = 0; t < num_tasks; ++t) {
+      unsigned numTry = t / (num_cost_funcs * num_angles);
+      unsigned ii = first_cost_func + t / num_angles % num_cost_funcs;
+      unsigned kk = t % num_angles;
+      vector<vector <unsigned> > final_routes_theta_temp;
+      populate_routes (points, node_order, orderings[numTry].data(), capacity, final_routes_theta_temp, ii, theta_vec[kk]);
+      double total_cost_theta_temp = get_total_cost_of_routes (final_routes_theta_temp, points);
+      if(total_cost_theta_temp < local_cost || (total_cost_theta_temp == local_cost && t < local_task)) {
+        local_cost = total_cost_theta_temp;
+        local_task = t;
+        local_routes.swap(final_routes_theta_temp);
+      }
+    }
+    #pragma omp critical
+    if(local_cost < final_total_cost || (local_cost == final_total_cost && local_task < best_task)) {
+      final_total_cost = local_cost;
+      best_task = local_task;
+      final_routes.swap(local_routes);
+    }
+  }
+  unsigned best_cost_function = first_cost_func + best_task / num_angles % num_cost_funcs;
+  unsigned best_ordering = best_task / (num_cost_funcs * num_angles) + 1;
   cout << "(Cost-function, node_ordering) that gave the best result for SCI = (" << best_cost_function << ", " << best_ordering << ")" << endl;
   vector<vector<unsigned> > postprocessed_final_routes = intra_route_TSP(final_routes, points);
   return postprocessed_final_routes;
@@ -981,6 +1135,28 @@ vector<vector<Edge> > PrimsMST(Points &points, vector<vector<Edge> > & graph, un
   }
   return nG;
 }
+// Same adjacency as PrimsMST, without the complete graph: from the Delaunay triangulation in O(n log n),
+// or by Boruvka over k-d tree nearest neighbour queries (parallel when built with OpenMP).
+vector<vector<Edge> > EuclideanMST(Points &points, const string& mst) {
+  unsigned N = points.dimension;
+  vector<pair<int,int> > edges;
+  if(mst == "boruvka")
+    boruvka_mst(N, points.x_coords, points.y_coords, 0, edges);
+  else
+    euclidean_mst(N, points.x_coords, points.y_coords, edges);
+  vector<int> toEdges;
+  tree_parents(N, edges, 0, toEdges);
+  vector<vector<Edge> > nG(N);
+  for(unsigned u=0; u < N; u++){
+    if(toEdges[u] != -1){
+      unsigned v = toEdges[u];
+      double wt = points.L2_dist(u,v);
+      nG[u].push_back(Edge(v,wt));
+      nG[v].push_back(Edge(u,wt));
+    }
+  }
+  return nG;
+}
 void ShortCircutTour(vector< vector<Edge> > &g, vector <bool> &visited, unsigned u, vector<unsigned> &out){
   visited [u] = true;
   out.push_back(u);
@@ -1013,17 +1189,23 @@ convertToVrpRoutes(Points &points, vector <unsigned> &singleRoute, unsigned capa
   routes.push_back(aRoute);
   return routes;
 }
-vector<vector<unsigned> > mst_dfs_approach (Points& points, unsigned capacity) {
+vector<vector<unsigned> > mst_dfs_approach (Points& points, unsigned capacity, const string& mst) {
   unsigned dimension = points.dimension;
-  vector<vector<Edge> > G (dimension);
-  for(size_t i=0; i < dimension; ++i){
-    for(size_t j=i+1; j < dimension; ++j){
-      double wt = points.L2_dist(i,j);
-      G[i].push_back(Edge(j,wt));
-      G[j].push_back(Edge(i,wt));
+  vector<vector<Edge> > mstG;
+  if(mst == "delaunay" || mst == "boruvka") {
+    mstG = EuclideanMST(points, mst);
+  }
+  else {
+    vector<vector<Edge> > G (dimension);
+    for(size_t i=0; i < dimension; ++i){
+      for(size_t j=i+1; j < dimension; ++j){
+        double wt = points.L2_dist(i,j);
+        G[i].push_back(Edge(j,wt));
+        G[j].push_back(Edge(i,wt));
+      }
     }
+    mstG = PrimsMST(points, G, capacity);
   }
-  vector<vector<Edge> > mstG = PrimsMST(points, G, capacity);
   vector <bool> visited(mstG.size(), false);
   visited[0] = true;
   vector <unsigned> singleRoute;
@@ -1052,7 +1234,8 @@ int main (int argc, char** argv) {
   int opt;
   string filename = "";
   bool round = false;
-  while ((opt = getopt(argc, argv, "f:r")) != -1)
+  string mst = "prim";
+  while ((opt = getopt(argc, argv, "f:rm:")) != -1)
   {
     switch (opt)
     {
@@ -1062,12 +1245,18 @@ int main (int argc, char** argv) {
       case 'r':
         round = true;
         break;
+      case 'm':
+        mst = string(optarg);
+        if(mst == "prim" || mst == "delaunay" || mst == "boruvka")
+          break;
+        // fall through - an unknown value prints the usage
       case 'h' :
       case '?' :
       default:
         cerr << "Usage: " << argv[0] << "\n"
           " -f : .vrp instance filename\n"
-          " -r : use distance values rounded to integers\n";
+          " -r : use distance values rounded to integers\n"
+          " -m : MST construction, prim (default), delaunay or boruvka\n";
         exit(1);
     }
   }
@@ -1075,19 +1264,21 @@ int main (int argc, char** argv) {
     cerr << "Input filename not specified!" << endl;
     cerr << "Usage: " << argv[0] << "\n"
       "\t-f : .vrp instance filename\n"
-      "\t-r : round distance to the nearest integer\n";
+      "\t-r : round distance to the nearest integer\n"
+      "\t-m : MST construction, prim (default), delaunay or boruvka\n";
     exit(1);
   }
   Points points;
   unsigned capacity = points.read (filename );
   points.cal_pairwise_distances();
+  points.cal_polar_index();
   unsigned dimension = points.dimension;
   chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
   double * distances_from_depot = (double*) malloc ((dimension-1) * sizeof(double));
   get_distances_from_depot (points, distances_from_depot);
   unsigned * node_order = (unsigned*) malloc ((dimension-1) * sizeof(unsigned));
   reorder_nodes (points, distances_from_depot, node_order);
-  vector<vector<unsigned> > postprocessed_final_routes_mst_dfs = mst_dfs_approach (points, capacity);
+  vector<vector<unsigned> > postprocessed_final_routes_mst_dfs = mst_dfs_approach (points, capacity, mst);
   double postprocessed_final_routes_mst_dfs_cost = get_total_cost_of_routes (postprocessed_final_routes_mst_dfs, points);
   vector<vector<unsigned> > postprocessed_final_routes_sci = sci_heuristic (points, capacity, node_order);
   double postprocessed_final_routes_sci_cost = get_total_cost_of_routes (postprocessed_final_routes_sci, points);
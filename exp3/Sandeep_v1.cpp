@@ -1,6 +1,6 @@
 //~~~START:Thu, 16-Jun-2022, 12:43:32 IST
 // For GECCO'23 Submission.
-// g++ -O3 -Wall -o "seqMDS".out "seqMDS.cpp"  -std=c++14
+// g++ -O3 -Wall -o "seqMDS".out "seqMDS.cpp"  -std=c++14 -I../include
 
 /*
  * Rajesh Pandian M | https://mrprajesh.co.in
@@ -23,6 +23,10 @@
 #include <random>
 #include <chrono>  //timing CPU
 
+#include "spatial-index.h"
+#include "route-search.h"
+#include "held-karp.h"
+
 unsigned DEBUGCODE = 0;
 #define DEBUG if (DEBUGCODE)
 
@@ -116,32 +120,37 @@ class VRP {
 //~ Decision to round or not round is actioned here
 std::vector<std::vector<Edge>>
 VRP::cal_graph_dist_mine() {
-    // select closest 30 nodes for each vertex
+    // select closest MIN_NODES nodes for each vertex
     std::vector<std::vector<Edge>> nG(size);
-    
+    KDTree kd;
+    kd.build_from(node);
 
+    std::vector<std::pair<double, int>> nbrs;
+    std::vector<int> ids;
     for(int i = 0; i < size; i++)
     {
-        std::priority_queue< std::pair<weight_t, int>> pq; // max heap
-
-        for(int j = 0; j < size; j++)
+        kd.knn(node[i].x, node[i].y, MIN_NODES, nbrs, i);
+        for(auto &nb : nbrs)
         {
-            if(j == i) continue;
-            weight_t w = sqrt(((node[i].x - node[j].x) * (node[i].x - node[j].x)) + ((node[i].y - node[j].y) * (node[i].y - node[j].y)));
-            w = (params.toRound ? round(w) : w);  //TO round or not to.
-            if(pq.size() < MIN_NODES)
-            {
-                pq.push({w, j});
-            }else if(pq.top().first > w)
+            nb.first = sqrt(nb.first);
+        }
+        if(params.toRound && !nbrs.empty())
+        {
+            // Rounding ties the weights. Pick up every node that rounds to at most the k-th weight
+            // and keep the smallest ids among the ties, as the brute force scan did.
+            kd.radius_if(node[i].x, node[i].y, round(nbrs.back().first) + 0.5, ids, [i](int id) { return id != i; });
+            nbrs.clear();
+            for(int j : ids)
             {
-                pq.pop();
-                pq.push({w, j});
+                nbrs.push_back({round(get_dist(i, j)), j});
             }
+            std::sort(nbrs.begin(), nbrs.end());
+            if(nbrs.size() > MIN_NODES) nbrs.resize(MIN_NODES);
         }
-        while(!pq.empty())
+        // farthest first, the order the max heap handed them out in
+        for(int t = (int)nbrs.size() - 1; t >= 0; t--)
         {
-            nG[i].push_back(Edge(pq.top().second, pq.top().first));
-            pq.pop();
+            nG[i].push_back(Edge(nbrs[t].second, nbrs[t].first));
         }
     }
     return nG;
@@ -424,6 +433,12 @@ void tsp_approx(const VRP &vrp, std::vector<node_t> &cities, std::vector<node_t>
 
   tour[0] = cities[ncities - 1];
 
+  if (ncities >= NN_TOUR_MIN_KD) {  // long route: nearest unvisited point from the k-d tree
+    nearest_neighbour_reorder(tour.data(), ncities, [&vrp](node_t v) { return vrp.node[v].x; },
+                              [&vrp](node_t v) { return vrp.node[v].y; });
+    return;
+  }
+
   for (i = 1; i < ncities; i++) {
     //~ double ThisX = points.x_coords[tour[i-1]];
     //~ double ThisY = points.y_coords[tour[i-1]];
@@ -480,60 +495,10 @@ postprocess_tsp_approx(const VRP &vrp, std::vector<std::vector<node_t>> &solRout
   return modifiedRoutes;
 }
 
-void tsp_2opt(const VRP &vrp, std::vector<node_t> &cities, std::vector<node_t> &tour, unsigned ncities) {
-  // 'cities' contains the original solution. It is updated during the course of the 2opt-scheme to contain the 2opt soln.
-  // 'tour' is an auxillary array.
-
-  // repeat until no improvement is made
-  unsigned improve = 0;
-
-  while (improve < 2) {
-    double best_distance = 0.0;
-
-    best_distance += vrp.get_dist(DEPOT, cities[0]);  // computing distance of the first point in the route with the depot.
-
-    for (unsigned jj = 1; jj < ncities; ++jj) {
-      best_distance += vrp.get_dist(cities[jj - 1], cities[jj]);
-    }
-
-    best_distance += vrp.get_dist(DEPOT, cities[ncities - 1]);
-    // 1x 2x 3x 4 5
-    //  1 2  3  4 5
-    for (unsigned i = 0; i < ncities - 1; i++) {
-      for (unsigned k = i + 1; k < ncities; k++) {
-        for (unsigned c = 0; c < i; ++c) {
-          tour[c] = cities[c];
-        }
-
-        unsigned dec = 0;
-        for (unsigned c = i; c < k + 1; ++c) {
-          tour[c] = cities[k - dec];
-          dec++;
-        }
-
-        for (unsigned c = k + 1; c < ncities; ++c) {
-          tour[c] = cities[c];
-        }
-        double new_distance = 0.0;
-
-        new_distance += vrp.get_dist(DEPOT, tour[0]);
-        for (unsigned jj = 1; jj < ncities; ++jj) {
-          new_distance += vrp.get_dist(tour[jj - 1], tour[jj]);
-        }
-
-        new_distance += vrp.get_dist(DEPOT, tour[ncities - 1]);
-
-        if (new_distance < best_distance) {
-          // Improvement found so reset
-          improve = 0;
-          for (unsigned jj = 0; jj < ncities; jj++)
-            cities[jj] = tour[jj];
-          best_distance = new_distance;
-        }
-      }
-    }
-    improve++;
-  }
+void tsp_2opt(const VRP &vrp, std::vector<node_t> &cities, unsigned ncities) {
+  // 'cities' contains the original solution. It is updated in place to contain the 2opt soln.
+  optimise_route(cities.data(), ncities, (node_t)DEPOT, [&vrp](node_t a, node_t b) { return vrp.get_dist(a, b); },
+                 [&vrp](node_t v) { return vrp.node[v].x; }, [&vrp](node_t v) { return vrp.node[v].y; });
 }
 
 std::vector<std::vector<node_t>>
@@ -546,7 +511,6 @@ postprocess_2OPT(const VRP &vrp, std::vector<std::vector<node_t>> &final_routes)
     unsigned sz = final_routes[i].size();
 
     std::vector<node_t> cities(sz);
-    std::vector<node_t> tour(sz);
 
     for (unsigned j = 0; j < sz; ++j)
       cities[j] = final_routes[i][j];
@@ -554,7 +518,7 @@ postprocess_2OPT(const VRP &vrp, std::vector<std::vector<node_t>> &final_routes)
     vector<node_t> curr_route;
 
     if (sz > 2)                         // for sz <= 1, the cost of the path cannot change. So no point running this.
-      tsp_2opt(vrp, cities, tour, sz);  //MAIN
+      tsp_2opt(vrp, cities, sz);  //MAIN
 
     for (unsigned kk = 0; kk < sz; ++kk) {
       curr_route.push_back(cities[kk]);
@@ -15,6 +15,13 @@
 #include <getopt.h>
 #include <cmath>
 #include <chrono>
+#include <queue>
+#include <tuple>
+
+#include "spatial-index.h"
+#include "emst.h"
+#include "route-search.h"
+#include "held-karp.h"
 
 #define PI 3.1415926535897932384626433832795028841971693993751
 using namespace std;
@@ -42,9 +49,17 @@ struct Points{
   double * y_coords;
   unsigned * demands;
   double *pairwise_dist;
+  double *radius;  // distance of every node from the depot
+  unsigned *by_angle;  // customers sorted by polar angle around the depot
+  double *sorted_angle;  // sorted_angle[i]: polar angle of by_angle[i], in [-PI, PI]
+  unsigned num_neighbours;
+  unsigned *neighbours;  // neighbours[v*num_neighbours ..]: nearest customers of v, closest first
+  double neighbour_radius;  // mean distance from a customer to its farthest candidate neighbour
   Points (void);
   unsigned read (string filename);
   void cal_pairwise_distances();
+  void cal_polar_index();
+  void cal_neighbours(unsigned k);
   double L2_dist (unsigned node1, unsigned node2);
   double L2_dist_squared (unsigned node1, unsigned node2);
 };
@@ -54,6 +69,12 @@ Points :: Points () {
   y_coords = nullptr;
   demands = nullptr;
   pairwise_dist = nullptr;
+  radius = nullptr;
+  by_angle = nullptr;
+  sorted_angle = nullptr;
+  num_neighbours = 0;
+  neighbours = nullptr;
+  neighbour_radius = 0.0;
 }
 unsigned Points :: read (string filename) {
   ifstream in(filename);
@@ -105,6 +126,40 @@ void Points :: cal_pairwise_distances() {
     }
   }
 }
+// Customers by angle around the depot, so that a cone at the depot is one or two contiguous
+// ranges of by_angle. O(n log n), once per instance.
+void Points :: cal_polar_index() {
+  radius = (double*) malloc(sizeof(double) * dimension);
+  by_angle = (unsigned*) malloc(sizeof(unsigned) * (dimension-1));
+  sorted_angle = (double*) malloc(sizeof(double) * (dimension-1));
+  vector<pair<double, unsigned> > vec (dimension-1);
+  radius[0] = 0.0;
+  for(unsigned v=1; v < dimension; ++v) {
+    radius[v] = sqrt((x_coords[v] * x_coords[v]) + (y_coords[v] * y_coords[v]));
+    vec[v-1] = make_pair(atan2(y_coords[v], x_coords[v]), v);
+  }
+  sort(vec.begin(), vec.end());
+  for(unsigned i=0; i < dimension-1; ++i) {
+    sorted_angle[i] = vec[i].first;
+    by_angle[i] = vec[i].second;
+  }
+}
+// Candidate lists for the granular inter-route moves, from a k-d tree in O(n k log n).
+// k == 0 leaves them empty: the moves search every position of every route pair.
+void Points :: cal_neighbours(unsigned k) {
+  num_neighbours = min(k, dimension > 2 ? dimension-2 : 0);
+  if (num_neighbours == 0) return;
+  neighbours = (unsigned*) malloc(sizeof(unsigned) * dimension * num_neighbours);
+  KDTree tree(dimension, x_coords, y_coords);
+  vector<pair<double, int> > nbrs;
+  for(unsigned v=1; v < dimension; ++v){
+    tree.knn_if(x_coords[v], y_coords[v], num_neighbours, nbrs, [v](int id) { return id != 0 && id != (int)v; });
+    for(unsigned i=0; i < num_neighbours; ++i)
+      neighbours[v*num_neighbours + i] = nbrs[i].second;
+    neighbour_radius += sqrt(nbrs.back().first);
+  }
+  neighbour_radius /= dimension-1;
+}
 bool compare_tuple1 (const order_tuple &lhs, const order_tuple &rhs){
   bool result = (get<0>(lhs) < get<0>(rhs)) || ((get<0>(lhs) == get<0>(rhs) && (get<1>(lhs) > get<1>(rhs))));
   return result;
@@ -177,7 +232,7 @@ bool isInRegion(DirVec& v1, DirVec& v2, DirVec& v3) {  //// ????
     return (!areClockwise(v1, v3) && areClockwise(v2, v3));
   else return false;
 }
-double get_cost_of_route (vector <unsigned> curr_route, Points& points) {
+double get_cost_of_route (const vector <unsigned>& curr_route, Points& points) {
   double curr_route_cost = 0;
   curr_route_cost += points.L2_dist(0,curr_route[0]);
   unsigned curr_route_size = curr_route.size();
@@ -195,6 +250,11 @@ void tsp_approx (unsigned* cities, unsigned* tour, Points& points, unsigned ncit
   for (i=1; i < ncities; i++)
     tour[i]=cities[i-1];
   tour[0] = cities[ncities-1];
+  if (ncities >= NN_TOUR_MIN_KD) {
+    nearest_neighbour_reorder(tour, ncities, [&points](unsigned v) { return points.x_coords[v]; },
+                              [&points](unsigned v) { return points.y_coords[v]; });
+    return;
+  }
   for (i=1; i < ncities; i++) {
     double ThisX = points.x_coords[tour[i-1]];
     double ThisY = points.y_coords[tour[i-1]];
@@ -216,153 +276,250 @@ void tsp_approx (unsigned* cities, unsigned* tour, Points& points, unsigned ncit
     tour[ClosePt] = temp;
   }
 }
-vector<unsigned> single_tsp_approx (vector<unsigned>& route, Points& points) {
-  unsigned sz = route.size();
-  unsigned* cities = (unsigned*) malloc(sizeof(unsigned) * (sz+1));
-  unsigned* tour = (unsigned*) malloc(sizeof(unsigned) * (sz+1));
-  for(unsigned j = 0; j < sz; ++j)
-    cities[j] = route[j];
-  cities[sz] = 0;
-  tsp_approx (cities, tour, points, sz+1);
-  vector<unsigned> curr_route;
-  for(unsigned kk = 1; kk < sz+1; ++kk) {
-    curr_route.push_back(tour[kk]);
+// Scratch of improve_around_customer, kept by the route under construction so that its neighbourhood
+// search allocates nothing
+struct PolishBuffers {
+  vector<unsigned> id, tour, at, pending;
+  vector<double> len, near;
+};
+// Polish after the customer at position v_pos joined curr_route. A route of up to POLISH_EXACT_MAX_LEN
+// customers is reordered exactly (held_karp is O(2^n n^2) and runs after every insertion, so the
+// bound is below HELD_KARP_MAX_LEN). A longer one gets 2-opt and Or-opt restricted to the
+// neighbourhood of the change: for a node u, the best 2-opt move that removes one of the two edges
+// at u, or the best Or-opt move of a segment of 1..3 customers holding u, in either orientation.
+// It starts from v; every applied move queues the customers at its new edges. edge_len is the
+// length of the edge leaving every position, the last one to the depot; removed edges are priced
+// from it and it is kept up to date. Examining a node costs O(route) and at most IMPROVE_MAX_NODES
+// are examined, so a call is O(route) and building a route of n customers O(n^2).
+// Returns whether the route changed.
+const unsigned POLISH_EXACT_MAX_LEN = 10;
+static_assert(POLISH_EXACT_MAX_LEN <= HELD_KARP_MAX_LEN, "held_karp takes the short routes");
+const unsigned IMPROVE_MAX_NODES = 32;
+const unsigned OR_OPT_MAX_LEN = 3;
+bool improve_around_customer (vector<unsigned>& curr_route, vector<double>& edge_len, Points& points, unsigned v_pos, PolishBuffers& buf) {
+  unsigned n = curr_route.size();
+  if (n < 3) return false;
+  if (n <= POLISH_EXACT_MAX_LEN) {
+    if (held_karp(curr_route.data(), n, 0u, [&points](unsigned a, unsigned b) { return points.L2_dist(a, b); }) == 0.0)  // kept as it was
+      return false;
+    for(unsigned p = 0; p < n; ++p)
+      edge_len[p] = points.L2_dist(curr_route[p], p+1 < n ? curr_route[p+1] : 0);
+    return true;
   }
-  return curr_route;
-}
-void tsp_2opt (unsigned* cities, unsigned* tour, Points& points, unsigned ncities) {
-#if 1
-  unsigned* cities_working_copy = (unsigned*) malloc(sizeof(unsigned) * (ncities+2));
-  cities_working_copy[0] = 0;
-  cities_working_copy[ncities+1] = 0;
-  for (unsigned i = 0; i < ncities; ++i) {
-    cities_working_copy[i+1] = cities[i];
-  }
-  unsigned improve = 0;
-  double minchange;
-  while ( improve < 1)
-  {
-    minchange = 0;
-    unsigned mini, minj;
-    for ( unsigned i = 0; i < ncities; i++ )
-    {
-      minchange += points.L2_dist(cities_working_copy[i], cities_working_copy[i+1]);
-      for ( unsigned j = i + 2; j < ncities+1; j++)
-      {
-        double change = points.L2_dist(cities_working_copy[i], cities_working_copy[j]) + points.L2_dist(cities_working_copy[i+1], cities_working_copy[j+1]) - points.L2_dist(cities_working_copy[j], cities_working_copy[j+1]);
-        if (minchange - change > 0.000001 ) {
-          minchange = change;
-          mini = i;
-          minj = j;
+  // Customers by their slot k = 1..n in curr_route; 0 and n+1 are the depot at both ends.
+  vector<unsigned>& id = buf.id;
+  vector<unsigned>& tour = buf.tour;  // tour[p]: slot at position p
+  vector<unsigned>& at = buf.at;      // at[k]: position of slot k
+  vector<double>& len = buf.len;      // len[p]: edge from position p to p+1
+  id.resize(n+2);
+  tour.resize(n+2);
+  at.resize(n+2);
+  len.resize(n+1);
+  id[0] = id[n+1] = 0;
+  copy(curr_route.begin(), curr_route.end(), id.begin()+1);
+  for(unsigned p = 0; p < n+2; ++p)
+    tour[p] = at[p] = p;
+  len[0] = points.L2_dist(0, curr_route[0]);
+  copy(edge_len.begin(), edge_len.end(), len.begin()+1);
+  auto dist = [&](unsigned p, unsigned q) { return points.L2_dist(id[tour[p]], id[tour[q]]); };
+  vector<unsigned>& pending = buf.pending;
+  pending.assign(1, v_pos + 1);
+  bool changed = false;
+  for(unsigned examined = 0; !pending.empty() && examined < IMPROVE_MAX_NODES; ++examined) {
+    unsigned u = pending.back();
+    pending.pop_back();
+    unsigned m = at[u];
+    // Every move below prices its new edges from a position within two of m: their distances to
+    // the whole route are looked up once, near(q, p) = dist(q, p) for |q - m| <= 2
+    unsigned w = n+2;
+    buf.near.resize(5*w);
+    for(unsigned q = m > 2 ? m-2 : 0; q <= m+2 && q <= n+1; ++q) {
+      double* row = &buf.near[(q+2-m)*w];
+      for(unsigned p = 0; p < w; ++p)
+        row[p] = dist(q, p);
+    }
+    auto near = [&](unsigned q, unsigned p) { return buf.near[(q+2-m)*w + p]; };
+    double best_gain = 0.000001;
+    unsigned move = 0, best_i = 0, best_j = 0, best_s = 0, best_l = 0;
+    bool best_rev = false;
+    // 2-opt: edges (i, i+1) and (j, j+1), one of them at u, replaced by (i, j) and (i+1, j+1)
+    for(unsigned e : {m-1, m}) {
+      for(unsigned f = 0; f <= n; ++f) {
+        if (f+1 >= e && f <= e+1) continue;
+        unsigned i = min(e, f), j = max(e, f);
+        double gain = len[i] + len[j] - near(e, f) - near(e+1, f+1);
+        if (gain > best_gain) {
+          best_gain = gain;
+          move = 1;
+          best_i = i;
+          best_j = j;
         }
       }
-      minchange -= points.L2_dist(cities_working_copy[i], cities_working_copy[i+1]);
-    }
-    improve++;
-    if (minchange < -0.1) {
-      improve = 0;
-      unsigned start = mini+1;
-      unsigned end = minj ;
-      while (start < end) {
-        unsigned to = cities_working_copy[end];
-        cities_working_copy[end] = cities_working_copy[start];
-        cities_working_copy[start] = to;
-        start++;
-        end--;
+    }
+    // Or-opt: the segment s..s+l-1 holding u moved between i and i+1, reversed if rev
+    for(unsigned l = 1; l <= OR_OPT_MAX_LEN && l <= n; ++l) {
+      for(unsigned s = m+1 > l ? m+1-l : 1; s <= m && s+l-1 <= n; ++s) {
+        unsigned t = s+l-1;
+        double removed = len[s-1] + len[t] - dist(s-1, t+1);
+        for(unsigned i = 0; i <= n; ++i) {
+          if (i+1 >= s && i <= t) continue;
+          for(bool rev : {false, true}) {
+            if (rev && l == 1) break;
+            double added = rev ? near(t, i) + near(s, i+1) : near(s, i) + near(t, i+1);
+            double gain = removed - (added - len[i]);
+            if (gain > best_gain) {
+              best_gain = gain;
+              move = 2;
+              best_i = i;
+              best_s = s;
+              best_l = l;
+              best_rev = rev;
+            }
+          }
+        }
       }
     }
+    if (move == 0) continue;
+    unsigned touched[4];
+    if (move == 1) {
+      touched[0] = tour[best_i]; touched[1] = tour[best_i+1]; touched[2] = tour[best_j]; touched[3] = tour[best_j+1];
+      reverse(tour.begin() + best_i + 1, tour.begin() + best_j + 1);
+      reverse(len.begin() + best_i + 1, len.begin() + best_j);
+      len[best_i] = dist(best_i, best_i+1);
+      len[best_j] = dist(best_j, best_j+1);
+      for(unsigned p = best_i + 1; p <= best_j; ++p)
+        at[tour[p]] = p;
+    }
+    else {
+      unsigned s = best_s, t = best_s + best_l - 1, lo, hi;  // positions whose slot changed
+      touched[0] = tour[s-1]; touched[1] = tour[t+1]; touched[2] = tour[best_i]; touched[3] = tour[best_i+1];
+      if (best_i < s) {
+        rotate(tour.begin() + best_i + 1, tour.begin() + s, tour.begin() + t + 1);
+        lo = best_i + 1;
+        hi = t;
+        if (best_rev) reverse(tour.begin() + lo, tour.begin() + lo + best_l);
+      }
+      else {
+        rotate(tour.begin() + s, tour.begin() + t + 1, tour.begin() + best_i + 1);
+        lo = s;
+        hi = best_i;
+        if (best_rev) reverse(tour.begin() + hi + 1 - best_l, tour.begin() + hi + 1);
+      }
+      for(unsigned p = lo; p <= hi; ++p)
+        at[tour[p]] = p;
+      for(unsigned p = lo - 1; p <= hi; ++p)
+        len[p] = dist(p, p+1);
+    }
+    pending.push_back(u);
+    for(unsigned w : touched)
+      if (w != 0 && w != n+1 && w != u) pending.push_back(w);
+    changed = true;
   }
-  for (unsigned i=0; i < ncities; ++i) {
-    cities[i] = cities_working_copy[i+1];
+  if (changed) {
+    for(unsigned p = 1; p <= n; ++p)
+      curr_route[p-1] = id[tour[p]];
+    copy(len.begin()+1, len.end(), edge_len.begin());
   }
-#endif
+  return changed;
 }
-vector<unsigned> single_2OPT (vector<unsigned>& route, Points& points) {
-  unsigned sz = route.size();
-  unsigned* cities = (unsigned*) malloc(sizeof(unsigned) * (sz));
-  unsigned* tour = (unsigned*) malloc(sizeof(unsigned) * (sz));
-  for(unsigned j = 0; j < sz; ++j)
-    cities[j] = route[j];
-  vector<unsigned> curr_route;
-  if(sz > 2)
-    tsp_2opt (cities, tour, points, sz);
-  for(unsigned kk = 0; kk < sz; ++kk) {
-    curr_route.push_back(cities[kk]);
+// Insertion cost COST_FUNC of a customer at squared distance dist1 from the node before it and
+// dist2 from the node after it, on an edge of squared length dist_edge_removed. COST_FUNC is a
+// compile-time constant, so the switch folds away. Costs out of range wrap through long long, as
+// the plain (unsigned) casts did on x86-64.
+template <unsigned COST_FUNC>
+inline unsigned get_insertion_cost (double dist1, double dist2, double dist_edge_removed) {
+  double new_increase_in_cost = 0;
+  switch (COST_FUNC) {
+    case 0:  // no preference: every position ties, the first one wins
+      new_increase_in_cost = 0;
+      break;
+    case 1:
+      new_increase_in_cost = dist1;
+      break;
+    case 2:
+      new_increase_in_cost = dist2;
+      break;
+    case 3:
+      new_increase_in_cost = max(dist1,dist2);
+      break;
+    case 4:
+      new_increase_in_cost = min(dist1,dist2);
+      break;
+    case 5:
+      new_increase_in_cost = dist1 + dist2;
+      break;
+    case 6:
+      new_increase_in_cost = dist1*dist1 + dist2*dist2;
+      break;
+    case 7:
+      new_increase_in_cost = dist1 + dist2 - dist_edge_removed;
+      break;
   }
-  return curr_route;
+  return (unsigned) (long long) new_increase_in_cost;
 }
-double get_best_position_in_route (vector<unsigned> curr_route, Points& points, unsigned& curr_pos, unsigned v) {
-  double min_increase_in_cost = DBL_MAX;
-  unsigned pos;
-  double dist1, dist2, dist_edge_removed;
-  unsigned curr_route_size = curr_route.size();
-  for(unsigned i=0; i < curr_route_size; ++i) {
-    dist1 = points.L2_dist(curr_route[i], v);
-    if (i == (curr_route_size - 1)) {
-      dist2 = points.L2_dist(0, v);
-      dist_edge_removed = points.L2_dist(0,curr_route[i]);
-    }
-    else {
-      dist2 = points.L2_dist(v, curr_route[i+1]);
-      dist_edge_removed = points.L2_dist(curr_route[i],curr_route[i+1]);
-    }
-    double new_increase_in_cost = dist1 + dist2 - dist_edge_removed;
-    if (new_increase_in_cost < min_increase_in_cost) {
-      min_increase_in_cost = new_increase_in_cost;
-      pos = i;
-    }
-  }
-  curr_pos = pos;
-  return min_increase_in_cost;
+// Squared length of the edge leaving every position of a route, the last one to the depot, from
+// their lengths edge_len (L2_dist_squared is the square of L2_dist, so the values are the same)
+void get_route_edges_squared (const vector<double>& edge_len, vector<double>& edge_sq) {
+  edge_sq.resize(edge_len.size());
+  for(unsigned i=0; i < edge_len.size(); ++i)
+    edge_sq[i] = edge_len[i] * edge_len[i];
 }
-unsigned get_best_position_in_route (vector<unsigned> curr_route, Points& points, unsigned& curr_pos, unsigned v, const unsigned cost_func_id ) {
+// Best position to insert a customer after, from dist_to_v: its squared distance to every node of
+// the route and, last, to the depot. Ties go to the first position.
+template <unsigned COST_FUNC>
+unsigned get_best_position_in_route (const vector<double>& edge_sq, const vector<double>& dist_to_v, unsigned& curr_pos) {
   unsigned min_increase_in_cost = UINT_MAX;
-  unsigned pos;
-  double dist1, dist2, dist_edge_removed;
-  unsigned curr_route_size = curr_route.size();
+  unsigned pos = 0;
+  unsigned curr_route_size = edge_sq.size();
   for(unsigned i=0; i < curr_route_size; ++i) {
-    dist1 = points.L2_dist_squared(curr_route[i], v);
-    if (i == (curr_route_size - 1)) {
-      dist2 = points.L2_dist_squared(0,v);
-      dist_edge_removed = points.L2_dist_squared(0,curr_route[i]);
-    }
-    else {
-      dist2 = points.L2_dist_squared(v,curr_route[i+1]);
-      dist_edge_removed = points.L2_dist_squared(curr_route[i],curr_route[i+1]);
-    }
-    unsigned new_increase_in_cost;
-    switch (cost_func_id) {
-      case 1:
-        new_increase_in_cost = (unsigned) dist1;
-        break;
-      case 2:
-        new_increase_in_cost = (unsigned) dist2;
-        break;
-      case 3:
-        new_increase_in_cost = (unsigned) max(dist1,dist2);
-        break;
-      case 4:
-        new_increase_in_cost = (unsigned) min(dist1,dist2);
-        break;
-      case 5:
-        new_increase_in_cost = (unsigned) (dist1 + dist2);
-        break;
-      case 6:
-        new_increase_in_cost = (unsigned) (dist1*dist1 + dist2*dist2);
-        break;
-      case 7:
-        new_increase_in_cost = (unsigned) (dist1 + dist2 - dist_edge_removed);
-        break;
-    }
-    if (new_increase_in_cost < min_increase_in_cost) {
-      min_increase_in_cost = new_increase_in_cost;
-      pos = i;
-    }
+    unsigned new_increase_in_cost = get_insertion_cost<COST_FUNC> (dist_to_v[i], dist_to_v[i+1], edge_sq[i]);
+    pos = new_increase_in_cost < min_increase_in_cost ? i : pos;
+    min_increase_in_cost = min(new_increase_in_cost, min_increase_in_cost);
   }
   curr_pos = pos;
   return min_increase_in_cost;
 }
-vector <unsigned> get_route (Points &points, unsigned* node_order, unsigned* shuffled_order, const unsigned capacity, unsigned& num_nodes_included, bool * isIncluded, const unsigned cost_func_id, unsigned cone_angle) {
+// Customers not yet included that lie in the cone of get_route: between dir_vec2 and dir_vec3,
+// cone_rad either side of dir_vec1 at polar angle angle1. Only the angular range of the cone is
+// scanned; the test itself is the one of the full scan, so the result is the same. Nodes come
+// in their order in shuffled_order (order_rank[v] = position of v), which breaks cost ties.
+void get_nodes_in_cone (Points& points, const unsigned* order_rank, const bool* isIncluded, DirVec& dir_vec1, DirVec& dir_vec2, DirVec& dir_vec3, double angle1, double cone_rad, vector<unsigned>& nodes_in_region) {
+  const unsigned n = points.dimension-1;
+  vector<pair<unsigned, unsigned> > found;  // {rank, node}
+  auto scan = [&](double lo, double hi) {
+    unsigned i = lower_bound(points.sorted_angle, points.sorted_angle + n, lo) - points.sorted_angle;
+    for(; i < n && points.sorted_angle[i] <= hi; ++i) {
+      unsigned p1 = points.by_angle[i];
+      if (isIncluded[p1]) continue;
+      DirVec dir_vec4 ;
+      dir_vec4.x = points.x_coords[p1]/points.radius[p1];
+      dir_vec4.y = points.y_coords[p1]/points.radius[p1];
+      if (isInRegion(dir_vec1, dir_vec2, dir_vec4) || isInRegion(dir_vec1, dir_vec3, dir_vec4))
+        found.push_back(make_pair(order_rank[p1], p1));
+    }
+  };
+  const double slack = 1e-9;  // atan2 and the cross products may disagree right at the edges
+  double lo = angle1 - cone_rad - slack;
+  double hi = angle1 + cone_rad + slack;
+  if (hi - lo >= 2*PI)
+    scan(-DBL_MAX, DBL_MAX);
+  else if (lo < -PI) {
+    scan(-DBL_MAX, hi);
+    scan(lo + 2*PI, DBL_MAX);
+  }
+  else if (hi > PI) {
+    scan(-DBL_MAX, hi - 2*PI);
+    scan(lo, DBL_MAX);
+  }
+  else
+    scan(lo, hi);
+  sort(found.begin(), found.end());
+  nodes_in_region.clear();
+  for(auto& f : found)
+    nodes_in_region.push_back(f.second);
+}
+template <unsigned COST_FUNC>
+vector <unsigned> get_route (Points &points, unsigned* node_order, const unsigned* order_rank, const unsigned capacity, unsigned& num_nodes_included, bool * isIncluded, unsigned cone_angle) {
   vector<unsigned> curr_route;
   unsigned route_capacity_remaining = capacity;
   for(unsigned i=0; i < points.dimension-1; ++i) {
@@ -397,62 +554,80 @@ vector <unsigned> get_route (Points &points, unsigned* node_order, unsigned* shu
   dir_vec3.x = x_temp / v_magnitude;
   dir_vec3.y = y_temp / v_magnitude;
   vector<unsigned> nodes_in_region;
-  for(unsigned i=0; i < points.dimension-1; ++i) {
-    unsigned p1 = shuffled_order[i];
-    DirVec dir_vec4 ;
-    v_magnitude = sqrt((points.x_coords[p1] * points.x_coords[p1]) + (points.y_coords[p1] * points.y_coords[p1]));
-    dir_vec4.x = points.x_coords[p1]/v_magnitude;
-    dir_vec4.y = points.y_coords[p1]/v_magnitude;
-    bool region_flag1 = isInRegion(dir_vec1, dir_vec2, dir_vec4);
-    bool region_flag2 = isInRegion(dir_vec1, dir_vec3, dir_vec4);
-    if (region_flag1 || region_flag2) {
-      nodes_in_region.push_back(p1);
-    }
-  }
+  get_nodes_in_cone (points, order_rank, isIncluded, dir_vec1, dir_vec2, dir_vec3, atan2(points.y_coords[first_node_of_route], points.x_coords[first_node_of_route]), theta1_rad, nodes_in_region);
+  // Insertion cache: cand_inc[ii] and cand_pos[ii] are what get_best_position_in_route returns for
+  // nodes_in_region[ii] on the current route. An insertion after position p only replaces the edge
+  // leaving p by two edges, so a candidate is rescanned only if its best position was p; otherwise
+  // the two new positions are priced against its cached best. Ties go to the lower position, as in
+  // the full scan. Reoptimising the whole route invalidates the cache.
+  unsigned nodes_in_region_sz = nodes_in_region.size();
+  vector<unsigned> cand_inc (nodes_in_region_sz), cand_pos (nodes_in_region_sz);
+  bool cache_valid = false;
+  vector<double> edge_len (1, points.L2_dist(first_node_of_route, 0));  // as improve_around_customer keeps it
+  vector<double> edge_sq, dist_to_v;
+  PolishBuffers polish;
+  auto best_position = [&](unsigned v, unsigned& pos) {
+    unsigned curr_route_size = curr_route.size();
+    dist_to_v.resize(curr_route_size+1);
+    for(unsigned i=0; i < curr_route_size; ++i)
+      dist_to_v[i] = points.L2_dist_squared(curr_route[i], v);
+    dist_to_v[curr_route_size] = points.L2_dist_squared(0, v);
+    return get_best_position_in_route<COST_FUNC> (edge_sq, dist_to_v, pos);
+  };
   while(true) {
+    if (!cache_valid) get_route_edges_squared (edge_len, edge_sq);
     unsigned least_inc = UINT_MAX;
-    unsigned best_pos;
-    unsigned best_node;
-    unsigned flag = false;
-    unsigned nodes_in_region_sz = nodes_in_region.size();
+    unsigned best_ii = UINT_MAX;  // the first feasible candidate wins even at cost UINT_MAX
     for(unsigned ii=0; ii < nodes_in_region_sz; ++ii) {
       unsigned v = nodes_in_region[ii];
       if(isIncluded[v]) continue;
       if(route_capacity_remaining < points.demands[v]) continue;
-      flag = true;
-      unsigned curr_pos;
-      unsigned curr_inc = get_best_position_in_route (curr_route, points, curr_pos, v, cost_func_id);
-      if (curr_inc < least_inc) {
-        least_inc = curr_inc;
-        best_pos = curr_pos;
-        best_node = v;
+      if (!cache_valid)
+        cand_inc[ii] = best_position (v, cand_pos[ii]);
+      if (best_ii == UINT_MAX || cand_inc[ii] < least_inc) {
+        least_inc = cand_inc[ii];
+        best_ii = ii;
       }
     }
-    if (!flag) break;
+    if (best_ii == UINT_MAX) break;
+    cache_valid = true;
+    unsigned best_pos = cand_pos[best_ii];
+    unsigned best_node = nodes_in_region[best_ii];
     auto it = curr_route.begin() + best_pos + 1;
     curr_route.insert(it,best_node);
     route_capacity_remaining -= points.demands[best_node];
     isIncluded[best_node] = true;
     num_nodes_included += 1;
-    if(curr_route.size() > 2 && curr_route.size() < 30) {
-      vector<unsigned> curr_route1 = single_2OPT(curr_route, points);
-      vector<unsigned> curr_route2 = single_tsp_approx(curr_route, points);
-      vector<unsigned> curr_route3 = single_2OPT(curr_route2, points);
-      double curr_length = get_cost_of_route (curr_route, points);
-      double curr1_length = get_cost_of_route (curr_route1, points);
-      double curr3_length = get_cost_of_route (curr_route3, points);
-      double curr13_length = DBL_MAX;
-      vector<unsigned> curr13_route;
-      if (curr3_length < curr1_length) {
-        curr13_length = curr3_length;
-        curr13_route = curr_route3;
+    unsigned next_node = best_pos + 2 < curr_route.size() ? curr_route[best_pos+2] : 0;
+    edge_len[best_pos] = points.L2_dist(curr_route[best_pos], best_node);
+    edge_len.insert(edge_len.begin() + best_pos + 1, points.L2_dist(best_node, next_node));
+    if (improve_around_customer (curr_route, edge_len, points, best_pos + 1, polish))
+      cache_valid = false;
+    if (!cache_valid) continue;
+    edge_sq[best_pos] = edge_len[best_pos] * edge_len[best_pos];
+    edge_sq.insert(edge_sq.begin() + best_pos + 1, edge_len[best_pos+1] * edge_len[best_pos+1]);
+    for(unsigned ii=0; ii < nodes_in_region_sz; ++ii) {
+      unsigned v = nodes_in_region[ii];
+      if(isIncluded[v]) continue;
+      if(route_capacity_remaining < points.demands[v]) continue;
+      if (cand_pos[ii] == best_pos) {
+        cand_inc[ii] = best_position (v, cand_pos[ii]);
+        continue;
       }
-      else {
-        curr13_length = curr1_length;
-        curr13_route = curr_route1;
+      if (cand_pos[ii] > best_pos) cand_pos[ii] += 1;
+      double dist_prev = points.L2_dist_squared(curr_route[best_pos], v);
+      double dist_new = points.L2_dist_squared(best_node, v);
+      double dist_next = points.L2_dist_squared(next_node, v);
+      unsigned inc1 = get_insertion_cost<COST_FUNC> (dist_prev, dist_new, edge_sq[best_pos]);
+      unsigned inc2 = get_insertion_cost<COST_FUNC> (dist_new, dist_next, edge_sq[best_pos+1]);
+      if (inc1 < cand_inc[ii] || (inc1 == cand_inc[ii] && best_pos < cand_pos[ii])) {
+        cand_inc[ii] = inc1;
+        cand_pos[ii] = best_pos;
+      }
+      if (inc2 < cand_inc[ii] || (inc2 == cand_inc[ii] && best_pos + 1 < cand_pos[ii])) {
+        cand_inc[ii] = inc2;
+        cand_pos[ii] = best_pos + 1;
       }
-      if (curr13_length < curr_length)
-        curr_route = curr13_route;
     }
   }
   return curr_route;
@@ -529,6 +704,8 @@ vector <unsigned> get_route_nearest_neighbor (Points &points, unsigned* node_ord
     isIncluded[closestPt] = true;
     num_nodes_included += 1;
   }
+  vector<double> edge_len (1, points.L2_dist(curr_route[0], 0));  // as improve_around_customer keeps it
+  PolishBuffers polish;
   while(true) {
     unsigned v = curr_route[curr_route.size()-1];
     unsigned closestPt = UINT_MAX;
@@ -552,39 +729,26 @@ vector <unsigned> get_route_nearest_neighbor (Points &points, unsigned* node_ord
     route_capacity_remaining -= points.demands[closestPt];
     isIncluded[closestPt] = true;
     num_nodes_included += 1;
-    if(curr_route.size() > 2 && curr_route.size() < 30) {
-      vector<unsigned> curr_route1 = single_2OPT(curr_route, points);
-      vector<unsigned> curr_route2 = single_tsp_approx(curr_route, points);
-      vector<unsigned> curr_route3 = single_2OPT(curr_route2, points);
-      double curr_length = get_cost_of_route (curr_route, points);
-      double curr1_length = get_cost_of_route (curr_route1, points);
-      double curr3_length = get_cost_of_route (curr_route3, points);
-      double curr13_length = DBL_MAX;
-      vector<unsigned> curr13_route;
-      if (curr3_length < curr1_length) {
-        curr13_length = curr3_length;
-        curr13_route = curr_route3;
-      }
-      else {
-        curr13_length = curr1_length;
-        curr13_route = curr_route1;
-      }
-      if (curr13_length < curr_length)
-        curr_route = curr13_route;
-    }
+    edge_len.back() = points.L2_dist(v, closestPt);
+    edge_len.push_back(points.L2_dist(closestPt, 0));
+    improve_around_customer (curr_route, edge_len, points, curr_route.size() - 1, polish);
   }
   return curr_route;
 }
-void populate_routes (Points& points, unsigned * node_order, unsigned * shuffled_order, unsigned capacity, vector<vector <unsigned> >& final_routes, const unsigned cost_func_id, unsigned cone_angle) {
+template <unsigned COST_FUNC>
+void populate_routes (Points& points, unsigned * node_order, unsigned * shuffled_order, unsigned capacity, vector<vector <unsigned> >& final_routes, unsigned cone_angle) {
   bool* isIncluded = (bool*) malloc(sizeof(bool) * points.dimension);
   memset(isIncluded, 0, sizeof(bool) * (points.dimension));
   isIncluded[0] = true;
+  vector<unsigned> order_rank (points.dimension);
+  for(unsigned i=0; i < points.dimension-1; ++i)
+    order_rank[shuffled_order[i]] = i;
   unsigned num_nodes_included = 1;
   unsigned count = 0;
   unsigned cone_angle1 = cone_angle;
   while (num_nodes_included < points.dimension) {
     if (count > 0 && cone_angle < 85) {cone_angle += 5;}
-    vector<unsigned> curr_route = get_route (points, node_order, shuffled_order, capacity, num_nodes_included, isIncluded, cost_func_id, cone_angle);
+    vector<unsigned> curr_route = get_route<COST_FUNC> (points, node_order, order_rank.data(), capacity, num_nodes_included, isIncluded, cone_angle);
     unsigned sum_of_demands = 0;
     for(unsigned xyz = 0; xyz < curr_route.size(); ++xyz) {
       sum_of_demands += points.demands[curr_route[xyz]];
@@ -601,11 +765,29 @@ void populate_routes (Points& points, unsigned * node_order, unsigned * shuffled
     count = 0;
     cone_angle = cone_angle1;
   }
+  free(isIncluded);
 }
-void populate_routes1 (Points& points, unsigned * node_order, unsigned * shuffled_order, unsigned capacity, vector<vector <unsigned> >& final_routes, const unsigned cost_func_id, unsigned cone_angle) {
+// The cost function is dispatched once per construction, each one a separate instantiation
+void populate_routes (Points& points, unsigned * node_order, unsigned * shuffled_order, unsigned capacity, vector<vector <unsigned> >& final_routes, const unsigned cost_func_id, unsigned cone_angle) {
+  switch (cost_func_id) {
+    case 0: populate_routes<0> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 1: populate_routes<1> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 2: populate_routes<2> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 3: populate_routes<3> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 4: populate_routes<4> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 5: populate_routes<5> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 6: populate_routes<6> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 7: populate_routes<7> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+  }
+}
+template <unsigned COST_FUNC>
+void populate_routes1 (Points& points, unsigned * node_order, unsigned * shuffled_order, unsigned capacity, vector<vector <unsigned> >& final_routes, unsigned cone_angle) {
   bool* isIncluded = (bool*) malloc(sizeof(bool) * points.dimension);
   memset(isIncluded, 0, sizeof(bool) * (points.dimension));
   isIncluded[0] = true;
+  vector<unsigned> order_rank (points.dimension);
+  for(unsigned i=0; i < points.dimension-1; ++i)
+    order_rank[shuffled_order[i]] = i;
   unsigned num_nodes_included = 1;
   unsigned count = 0;
   unsigned cone_angle1 = cone_angle;
@@ -616,7 +798,7 @@ void populate_routes1 (Points& points, unsigned * node_order, unsigned * shuffle
     }
     unsigned num_nodes_included_copy = num_nodes_included;
     if (count > 0 && cone_angle < 85) {cone_angle += 5;}
-    vector<unsigned> curr_route_sci = get_route (points, node_order, shuffled_order, capacity, num_nodes_included, isIncluded, cost_func_id, cone_angle);
+    vector<unsigned> curr_route_sci = get_route<COST_FUNC> (points, node_order, order_rank.data(), capacity, num_nodes_included, isIncluded, cone_angle);
     for(unsigned xyz = 0; xyz < curr_route_sci.size(); ++xyz) {
       isIncluded[curr_route_sci[xyz]] = false;
     }
@@ -660,6 +842,18 @@ void populate_routes1 (Points& points, unsigned * node_order, unsigned * shuffle
     cone_angle = cone_angle1;
   }
 }
+void populate_routes1 (Points& points, unsigned * node_order, unsigned * shuffled_order, unsigned capacity, vector<vector <unsigned> >& final_routes, const unsigned cost_func_id, unsigned cone_angle) {
+  switch (cost_func_id) {
+    case 0: populate_routes1<0> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 1: populate_routes1<1> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 2: populate_routes1<2> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 3: populate_routes1<3> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 4: populate_routes1<4> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 5: populate_routes1<5> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 6: populate_routes1<6> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+    case 7: populate_routes1<7> (points, node_order, shuffled_order, capacity, final_routes, cone_angle); break;
+  }
+}
 bool verify_sol (vector<vector<unsigned> > final_routes, unsigned capacity, Points &points) {
   unsigned * hist = (unsigned*) malloc(sizeof(unsigned) * points.dimension);
   memset(hist, 0, sizeof(unsigned) * points.dimension);
@@ -732,12 +926,11 @@ vector<vector<unsigned> > postprocess_2OPT (vector<vector<unsigned> >& final_rou
   for(unsigned i=0; i < nroutes; ++i ) {
     unsigned sz = final_routes[i].size();
     unsigned* cities = (unsigned*) malloc(sizeof(unsigned) * (sz));
-    unsigned* tour = (unsigned*) malloc(sizeof(unsigned) * (sz));
     for(unsigned j = 0; j < sz; ++j)
       cities[j] = final_routes[i][j];
     vector<unsigned> curr_route;
-    if(sz > 2)
-      tsp_2opt (cities, tour, points, sz);
+    optimise_route(cities, sz, 0u, [&points](unsigned a, unsigned b) { return points.L2_dist(a, b); },
+                   [&points](unsigned v) { return points.x_coords[v]; }, [&points](unsigned v) { return points.y_coords[v]; });
     for(unsigned kk = 0; kk < sz; ++kk) {
       curr_route.push_back(cities[kk]);
     }
@@ -745,205 +938,369 @@ vector<vector<unsigned> > postprocess_2OPT (vector<vector<unsigned> >& final_rou
   }
   return postprocessed_final_routes;
 }
-bool isFeasible(vector<unsigned>& route1, vector<unsigned>& route2, unsigned capacity, Points& points) {
-  unsigned sum_demands1 = 0;
-  for(unsigned i = 0; i < route1.size(); ++i) {
-    sum_demands1 += points.demands[route1[i]];
+// Moves priced from the edges they touch are not exactly antisymmetric in floating point:
+// below this reduction a move and its reverse could both look improving and cycle.
+const double MIN_REDUCTION_IN_COST = 0.000001;
+// Arc of directions around the depot covered by a route, in 1/65536 turns, swept counter
+// clockwise from start to end (Vidal 2022). Extended point by point, so it may be wider than
+// the smallest arc, which only makes overlap() more permissive.
+struct CircleSector {
+  int start, end;
+  static int positive_mod (int i) { return (i % 65536 + 65536) % 65536; }
+  void initialize (int point) { start = end = point; }
+  bool is_enclosed (int point) const { return positive_mod(point - start) <= positive_mod(end - start); }
+  void extend (int point) {
+    if (is_enclosed(point)) return;
+    if (positive_mod(point - end) <= positive_mod(start - point)) end = point;
+    else start = point;
   }
-  unsigned sum_demands2 = 0;
-  for(unsigned i = 0; i < route2.size(); ++i) {
-    sum_demands2 += points.demands[route2[i]];
+  static bool overlap (const CircleSector& a, const CircleSector& b) {
+    return positive_mod(b.start - a.start) <= positive_mod(a.end - a.start) || positive_mod(a.start - b.start) <= positive_mod(b.end - b.start);
   }
-  if (sum_demands1 <= capacity && sum_demands2 <= capacity)
-    return true;
-  else return false;
-}
-bool isFeasible(vector<unsigned>& route, unsigned curr_node, unsigned capacity, Points& points) {
-  unsigned sum_demands = 0;
-  for(unsigned i = 0; i < route.size(); ++i) {
-    sum_demands += points.demands[route[i]];
+};
+// The three cheapest positions to insert a customer into a route, as the customer they follow
+// (0: in front), cheapest first. Unused entries have after == UINT_MAX.
+struct ThreeBestInsert {
+  double cost[3];
+  unsigned after[3];
+  void reset () {
+    for(unsigned t = 0; t < 3; ++t) { cost[t] = DBL_MAX; after[t] = UINT_MAX; }
+  }
+  void add (double c, unsigned a) {
+    if (c >= cost[2]) return;
+    unsigned t = 2;
+    for(; t > 0 && c < cost[t-1]; --t) { cost[t] = cost[t-1]; after[t] = after[t-1]; }
+    cost[t] = c;
+    after[t] = a;
+  }
+};
+// The routes of a solution with cached cost, load and prefix loads, plus the position of
+// every customer. Moves are priced from the edges they touch and the loads, without
+// copying or re-summing a route; only the routes changed by an applied move are refreshed.
+// Routes hold customers only, the depot is implicit at both ends.
+struct Route {
+  vector<unsigned> nodes;
+  double cost;
+  unsigned load;
+  vector<unsigned> prefix_load;  // prefix_load[j]: demand of nodes[0..j]
+  CircleSector sector;
+  double min_x, max_x, min_y, max_y;  // bounding box of the customers
+  unsigned size() const { return nodes.size(); }
+};
+struct RouteSet {
+  Points& points;
+  vector<Route> routes;
+  vector<unsigned> route_of;  // customer v is routes[route_of[v]].nodes[pos_of[v]]
+  vector<unsigned> pos_of;
+  vector<int> polar_angle;    // direction of every node from the depot, as in CircleSector
+  RouteSet (const vector<vector<unsigned> >& final_routes, Points& points);
+  void update (unsigned r);
+  void write_back (vector<vector<unsigned> >& final_routes) const;
+  bool may_interact (unsigned r, unsigned s) const;
+  unsigned pred (unsigned r, unsigned j) const { return j == 0 ? 0 : routes[r].nodes[j-1]; }
+  unsigned succ (unsigned r, unsigned j) const { return j + 1 == routes[r].size() ? 0 : routes[r].nodes[j+1]; }
+  double removal_gain (unsigned r, unsigned j) const;
+  double best_insertion (unsigned r, unsigned v, unsigned& pos) const;
+  double insertion_cost (unsigned s, unsigned idx, unsigned v) const;
+  void relocate (unsigned r, unsigned j, unsigned s, unsigned idx);
+  void preprocess_insertions (unsigned r, unsigned s, vector<ThreeBestInsert>& best) const;
+  double swap_insertion (const ThreeBestInsert& best, unsigned u, unsigned s, unsigned k, unsigned& after) const;
+  void replace (unsigned r, unsigned j, unsigned v, unsigned after);
+};
+RouteSet :: RouteSet (const vector<vector<unsigned> >& final_routes, Points& points) : points(points) {
+  routes.resize(final_routes.size());
+  route_of.assign(points.dimension, UINT_MAX);
+  pos_of.assign(points.dimension, UINT_MAX);
+  polar_angle.resize(points.dimension);
+  for(unsigned v = 0; v < points.dimension; ++v)
+    polar_angle[v] = CircleSector::positive_mod((int)(32768. * atan2(points.y_coords[v], points.x_coords[v]) / PI));
+  for(unsigned r = 0; r < routes.size(); ++r) {
+    routes[r].nodes = final_routes[r];
+    update(r);
   }
-  unsigned new_sum_demands = sum_demands + points.demands[curr_node];
-  if (new_sum_demands <= capacity)
-    return true;
-  else return false;
 }
-bool isFeasible(vector<unsigned>& final_routes_i, vector<unsigned>& final_routes_k, unsigned curr_node, unsigned candidate_node, unsigned capacity, Points& points) {
-  unsigned sum_demands_i = 0;
-  for(unsigned i = 0; i < final_routes_i.size(); ++i) {
-    sum_demands_i += points.demands[final_routes_i[i]];
+// Recomputes the caches of route r after its nodes changed
+void RouteSet :: update (unsigned r) {
+  Route& route = routes[r];
+  unsigned sz = route.size();
+  route.prefix_load.resize(sz);
+  double dist = 0.0;
+  unsigned load = 0;
+  for(unsigned j = 0; j < sz; ++j) {
+    unsigned v = route.nodes[j];
+    dist += points.L2_dist(j == 0 ? 0 : route.nodes[j-1], v);
+    load += points.demands[v];
+    route.prefix_load[j] = load;
+    route_of[v] = r;
+    pos_of[v] = j;
+    if (j == 0) route.sector.initialize(polar_angle[v]);
+    else route.sector.extend(polar_angle[v]);
+    if (j == 0) {
+      route.min_x = route.max_x = points.x_coords[v];
+      route.min_y = route.max_y = points.y_coords[v];
+    }
+    route.min_x = min(route.min_x, points.x_coords[v]);
+    route.max_x = max(route.max_x, points.x_coords[v]);
+    route.min_y = min(route.min_y, points.y_coords[v]);
+    route.max_y = max(route.max_y, points.y_coords[v]);
   }
-  unsigned sum_demands_k = 0;
-  for(unsigned i = 0; i < final_routes_k.size(); ++i) {
-    sum_demands_k += points.demands[final_routes_k[i]];
+  route.cost = sz == 0 ? 0.0 : dist + points.L2_dist(0, route.nodes[sz-1]);
+  route.load = load;
+}
+void RouteSet :: write_back (vector<vector<unsigned> >& final_routes) const {
+  final_routes.resize(routes.size());
+  for(unsigned r = 0; r < routes.size(); ++r)
+    final_routes[r] = routes[r].nodes;
+}
+// Whether an inter-route move between routes r and s is worth pricing: their polar sectors
+// overlap, or their bounding boxes are within points.neighbour_radius of each other.
+// Routes on opposite sides of the depot are skipped, which leaves about O(R) pairs.
+// Without candidate lists (-k 0) every pair is priced, for a full reference search.
+bool RouteSet :: may_interact (unsigned r, unsigned s) const {
+  if (points.num_neighbours == 0) return true;
+  const Route& a = routes[r];
+  const Route& b = routes[s];
+  if (CircleSector::overlap(a.sector, b.sector)) return true;
+  double dx = max(0.0, max(a.min_x - b.max_x, b.min_x - a.max_x));
+  double dy = max(0.0, max(a.min_y - b.max_y, b.min_y - a.max_y));
+  return dx * dx + dy * dy <= points.neighbour_radius * points.neighbour_radius;
+}
+// Saving from taking nodes[j] out of route r
+double RouteSet :: removal_gain (unsigned r, unsigned j) const {
+  unsigned p = pred(r, j), v = routes[r].nodes[j], n = succ(r, j);
+  return points.L2_dist(p, v) + points.L2_dist(v, n) - points.L2_dist(p, n);
+}
+// Cheapest insertion of v after some customer of route r, as get_best_position_in_route;
+// pos is the index of that customer. DBL_MAX if empty.
+double RouteSet :: best_insertion (unsigned r, unsigned v, unsigned& pos) const {
+  const vector<unsigned>& nodes = routes[r].nodes;
+  unsigned sz = nodes.size();
+  double min_increase_in_cost = DBL_MAX;
+  pos = UINT_MAX;
+  for(unsigned i = 0; i < sz; ++i) {
+    unsigned w = i + 1 < sz ? nodes[i+1] : 0;
+    double new_increase_in_cost = points.L2_dist(nodes[i], v) + points.L2_dist(v, w) - points.L2_dist(nodes[i], w);
+    if (new_increase_in_cost < min_increase_in_cost) {
+      min_increase_in_cost = new_increase_in_cost;
+      pos = i;
+    }
   }
-  unsigned new_sum_demands_i = sum_demands_i - points.demands[curr_node] + points.demands[candidate_node];
-  unsigned new_sum_demands_k = sum_demands_k - points.demands[candidate_node] + points.demands[curr_node];
-  if ((new_sum_demands_i <= capacity) && (new_sum_demands_k <= capacity) )
-    return true;
-  else return false;
+  return min_increase_in_cost;
 }
-void inter_route_2opt (vector<unsigned>& cities_i, vector<unsigned>& cities_j, Points& points, unsigned capacity) {
-#if 1
-  unsigned improve = 0;
-  double minchange;
-  while ( improve < 1)
-  {
-    minchange = 0;
-    unsigned minii, minjj;
-    unsigned cities_i_sz = cities_i.size();
-    unsigned cities_j_sz = cities_j.size();
-    unsigned * prefix_sum_demands_cities_i = (unsigned*)malloc(sizeof(unsigned) * cities_i_sz);
-    unsigned * prefix_sum_demands_cities_j = (unsigned*)malloc(sizeof(unsigned) * cities_j_sz);
-    prefix_sum_demands_cities_i[0] = points.demands[cities_i[0]];
-    for(unsigned x = 1; x < cities_i_sz; ++x) {
-      prefix_sum_demands_cities_i[x] = prefix_sum_demands_cities_i[x-1] + points.demands[cities_i[x]];
-    }
-    prefix_sum_demands_cities_j[0] = points.demands[cities_j[0]];
-    for(unsigned x = 1; x < cities_j_sz; ++x) {
-      prefix_sum_demands_cities_j[x] = prefix_sum_demands_cities_j[x-1] + points.demands[cities_j[x]];
-    }
-    for(unsigned ii = 0; ii < cities_i_sz - 1; ++ii) {
-      for(unsigned jj = 0; jj < cities_j_sz - 1; ++jj) {
-L1:
-        double change = points.L2_dist(cities_i[ii], cities_j[jj+1]) + points.L2_dist(cities_j[jj], cities_i[ii+1]) - points.L2_dist(cities_i[ii], cities_i[ii+1]) - points.L2_dist(cities_j[jj], cities_j[jj+1]);
-        if (minchange - change > 0.000001 ) {
-          unsigned sum_of_demands_cities_i = prefix_sum_demands_cities_i[ii] + prefix_sum_demands_cities_j[cities_j_sz - 1] - prefix_sum_demands_cities_j[jj];
-          unsigned sum_of_demands_cities_j = prefix_sum_demands_cities_j[jj] + prefix_sum_demands_cities_i[cities_i_sz - 1] - prefix_sum_demands_cities_i[ii];
-          if (sum_of_demands_cities_i > capacity || sum_of_demands_cities_j > capacity) continue;
-          minchange = change;
-          minii = ii;
-          minjj = jj;
-        }
-      }
+// Increase in the cost of route s if v is inserted at index idx (0 .. size), i.e. before nodes[idx]
+double RouteSet :: insertion_cost (unsigned s, unsigned idx, unsigned v) const {
+  unsigned p = idx == 0 ? 0 : routes[s].nodes[idx-1];
+  unsigned n = idx == routes[s].size() ? 0 : routes[s].nodes[idx];
+  return points.L2_dist(p, v) + points.L2_dist(v, n) - points.L2_dist(p, n);
+}
+// Moves nodes[j] of route r to index idx of route s (s != r)
+void RouteSet :: relocate (unsigned r, unsigned j, unsigned s, unsigned idx) {
+  unsigned v = routes[r].nodes[j];
+  routes[s].nodes.insert(routes[s].nodes.begin() + idx, v);
+  routes[r].nodes.erase(routes[r].nodes.begin() + j);
+  update(r);
+  update(s);
+}
+// best[i]: the three cheapest insertions of routes[r].nodes[i] into route s
+void RouteSet :: preprocess_insertions (unsigned r, unsigned s, vector<ThreeBestInsert>& best) const {
+  const vector<unsigned>& nodes = routes[s].nodes;
+  unsigned sz = nodes.size();
+  best.resize(routes[r].size());
+  for(unsigned i = 0; i < routes[r].size(); ++i) {
+    unsigned u = routes[r].nodes[i];
+    best[i].reset();
+    for(unsigned idx = 0; idx <= sz; ++idx) {
+      unsigned p = idx == 0 ? 0 : nodes[idx-1];
+      unsigned n = idx == sz ? 0 : nodes[idx];
+      best[i].add(points.L2_dist(p, u) + points.L2_dist(u, n) - points.L2_dist(p, n), p);
     }
-    improve++;
-    if (minchange < -0.000001) {
-      improve = 0;
-      unsigned new_size_of_cities_i = minii - minjj + cities_j_sz;
-      unsigned new_size_of_cities_j = minjj - minii + cities_i_sz;
-      vector<unsigned> tour_i (new_size_of_cities_i);
-      vector<unsigned> tour_j (new_size_of_cities_j);
-      unsigned k = 0;
-      for(unsigned c = 0; c <= minii; ++c) {
-        tour_i[k] = cities_i[c];
-        ++k;
-      }
-      for(unsigned c = minjj+1; c < cities_j_sz; ++c) {
-        tour_i[k] = cities_j[c];
-        ++k;
-      }
-      k = 0;
-      for(unsigned c = 0; c <= minjj; ++c) {
-        tour_j[k] = cities_j[c];
-        k++;
-      }
-      for(unsigned c = minii+1; c < cities_i_sz; ++c) {
-        tour_j[k] = cities_i[c];
-        k++;
+  }
+}
+// Cheapest insertion of u into route s once nodes[k] has been taken out: in its place or at one of
+// the precomputed positions that does not touch it. O(1)
+double RouteSet :: swap_insertion (const ThreeBestInsert& best, unsigned u, unsigned s, unsigned k, unsigned& after) const {
+  unsigned v = routes[s].nodes[k], p = pred(s, k), n = succ(s, k);
+  double cost = points.L2_dist(p, u) + points.L2_dist(u, n) - points.L2_dist(p, n);
+  after = p;
+  for(unsigned t = 0; t < 3; ++t) {
+    if (best.after[t] == UINT_MAX || best.after[t] == p || best.after[t] == v) continue;
+    if (best.cost[t] < cost) {
+      cost = best.cost[t];
+      after = best.after[t];
+    }
+    break;
+  }
+  return cost;
+}
+// Takes nodes[j] out of route r and inserts v after customer `after` of r (0: in front)
+void RouteSet :: replace (unsigned r, unsigned j, unsigned v, unsigned after) {
+  const vector<unsigned>& nodes = routes[r].nodes;
+  vector<unsigned> new_nodes;
+  new_nodes.reserve(nodes.size());
+  if (after == 0) new_nodes.push_back(v);
+  for(unsigned i = 0; i < nodes.size(); ++i) {
+    if (i == j) continue;
+    new_nodes.push_back(nodes[i]);
+    if (nodes[i] == after) new_nodes.push_back(v);
+  }
+  routes[r].nodes.swap(new_nodes);
+  update(r);
+}
+// Best 2-opt* move between routes i and j: nodes[0..ii] of i followed by nodes[jj+1..] of j,
+// and nodes[0..jj] of j followed by nodes[ii+1..] of i. Returns the change in cost (0 if none).
+// Reads the routes only, so pairs can be priced concurrently.
+double best_inter_route_2opt (const RouteSet& rs, unsigned i, unsigned j, unsigned capacity, unsigned& minii, unsigned& minjj) {
+  Points& points = rs.points;
+  double minchange = 0;
+  const vector<unsigned>& cities_i = rs.routes[i].nodes;
+  const vector<unsigned>& cities_j = rs.routes[j].nodes;
+  unsigned cities_i_sz = cities_i.size();
+  unsigned cities_j_sz = cities_j.size();
+  const vector<unsigned>& prefix_sum_demands_cities_i = rs.routes[i].prefix_load;
+  const vector<unsigned>& prefix_sum_demands_cities_j = rs.routes[j].prefix_load;
+  for(unsigned ii = 0; ii < cities_i_sz - 1; ++ii) {
+    for(unsigned jj = 0; jj < cities_j_sz - 1; ++jj) {
+      double change = points.L2_dist(cities_i[ii], cities_j[jj+1]) + points.L2_dist(cities_j[jj], cities_i[ii+1]) - points.L2_dist(cities_i[ii], cities_i[ii+1]) - points.L2_dist(cities_j[jj], cities_j[jj+1]);
+      if (minchange - change > 0.000001 ) {
+        unsigned sum_of_demands_cities_i = prefix_sum_demands_cities_i[ii] + prefix_sum_demands_cities_j[cities_j_sz - 1] - prefix_sum_demands_cities_j[jj];
+        unsigned sum_of_demands_cities_j = prefix_sum_demands_cities_j[jj] + prefix_sum_demands_cities_i[cities_i_sz - 1] - prefix_sum_demands_cities_i[ii];
+        if (sum_of_demands_cities_i > capacity || sum_of_demands_cities_j > capacity) continue;
+        minchange = change;
+        minii = ii;
+        minjj = jj;
       }
-      cities_i = tour_i;
-      cities_j = tour_j;
     }
   }
-#endif
+  return minchange;
+}
+void apply_inter_route_2opt (RouteSet& rs, unsigned i, unsigned j, unsigned minii, unsigned minjj) {
+  const vector<unsigned>& cities_i = rs.routes[i].nodes;
+  const vector<unsigned>& cities_j = rs.routes[j].nodes;
+  vector<unsigned> tour_i (cities_i.begin(), cities_i.begin() + minii + 1);
+  vector<unsigned> tour_j (cities_j.begin(), cities_j.begin() + minjj + 1);
+  tour_i.insert(tour_i.end(), cities_j.begin() + minjj + 1, cities_j.end());
+  tour_j.insert(tour_j.end(), cities_i.begin() + minii + 1, cities_i.end());
+  rs.routes[i].nodes.swap(tour_i);
+  rs.routes[j].nodes.swap(tour_j);
+  rs.update(i);
+  rs.update(j);
 }
+// Best 2-opt* move of a route pair, as priced by best_inter_route_2opt; sorted from the largest gain
+struct StarMove {
+  double change;
+  unsigned i, j;    // routes, i < j
+  unsigned ii, jj;  // cut positions, as in best_inter_route_2opt
+  bool operator< (const StarMove& o) const { return make_tuple(change, i, j) < make_tuple(o.change, o.i, o.j); }
+};
+// 2-opt* over the route pairs for which RouteSet::may_interact holds, in rounds. Every such pair
+// with a route changed in the previous round is priced in parallel, then improving moves are
+// applied greedily from the largest gain on, at most one per route, so the moves of a round never
+// conflict. Only improving moves are kept, and only while neither of their routes changes, so the
+// cache holds O(R) moves. Stops when no pair has an improving move.
 void Two_opt_star (vector<vector<unsigned> >& postprocessed_final_routes, unsigned capacity, Points& points) {
-  double n_cost = DBL_MAX;
-  double o_cost = DBL_MAX;
-  do {
-    o_cost = n_cost;
-    unsigned nroutes = postprocessed_final_routes.size();
+  RouteSet rs (postprocessed_final_routes, points);
+  unsigned nroutes = rs.routes.size();
+  vector<char> changed (nroutes, 1);
+  vector<char> used (nroutes);
+  vector<StarMove> priced;
+  vector<StarMove> improving;
+  while (true) {
+    improving.erase(remove_if(improving.begin(), improving.end(),
+                              [&changed](const StarMove& m) { return changed[m.i] || changed[m.j]; }), improving.end());
+    priced.clear();
     for(unsigned i=0; i < nroutes; ++i ) {
-      if(postprocessed_final_routes[i].size() == 1) continue;
-      for(unsigned j=i+1; j < nroutes; ++j ) {
-        if(postprocessed_final_routes[j].size() == 1) continue;
-        vector<unsigned> cities_i = postprocessed_final_routes[i];
-        vector<unsigned> cities_j = postprocessed_final_routes[j];
-        inter_route_2opt (cities_i, cities_j, points, capacity);
-        postprocessed_final_routes[i].clear();
-        postprocessed_final_routes[j].clear();
-        for(unsigned xyz = 0; xyz < cities_i.size(); ++xyz)
-          postprocessed_final_routes[i].push_back(cities_i[xyz]);
-        for(unsigned xyz = 0; xyz < cities_j.size(); ++xyz)
-          postprocessed_final_routes[j].push_back(cities_j[xyz]);
+      if(rs.routes[i].size() == 1 || !changed[i]) continue;
+      for(unsigned j=0; j < nroutes; ++j ) {
+        if(j == i || rs.routes[j].size() == 1) continue;
+        if (changed[j] && j < i) continue;  // listed from j
+        StarMove m;
+        m.i = min(i, j);
+        m.j = max(i, j);
+        if (rs.may_interact(m.i, m.j)) priced.push_back(m);
       }
     }
-    n_cost = get_total_cost_of_routes(postprocessed_final_routes,points);
-  }while(n_cost < o_cost);
+    unsigned npairs = priced.size();
+    #pragma omp parallel for schedule(dynamic, 16)
+    for(unsigned p = 0; p < npairs; ++p) {
+      StarMove& m = priced[p];
+      m.change = best_inter_route_2opt (rs, m.i, m.j, capacity, m.ii, m.jj);
+    }
+    for(unsigned p = 0; p < npairs; ++p) {
+      if (priced[p].change < -0.000001) improving.push_back(priced[p]);
+    }
+    if (improving.empty()) break;
+    sort (improving.begin(), improving.end());
+    fill (changed.begin(), changed.end(), 0);
+    fill (used.begin(), used.end(), 0);
+    for(unsigned m = 0; m < improving.size(); ++m) {
+      unsigned i = improving[m].i, j = improving[m].j;
+      if (used[i] || used[j]) continue;
+      used[i] = used[j] = 1;
+      apply_inter_route_2opt (rs, i, j, improving[m].ii, improving[m].jj);
+      changed[i] = changed[j] = 1;
+    }
+  }
+  rs.write_back(postprocessed_final_routes);
 }
+// SWAP* (Vidal 2022): exchanges a customer u of route r with a customer v of route s, each going
+// to its cheapest position in the other route rather than strictly in the other's place.
+// Only pairs of routes for which RouteSet::may_interact holds are tried. With the three best insertion
+// positions of every customer precomputed, a route pair costs O(|r| |s|).
 void swap_star(vector<vector<unsigned> >& postprocessed_final_routes, unsigned capacity, Points& points) {
+  RouteSet rs (postprocessed_final_routes, points);
+  vector<Route>& routes = rs.routes;
+  vector<ThreeBestInsert> best_in_s, best_in_r;
   bool anotherIter;
   do {
     anotherIter = false;
-    for(unsigned i = 0; i < postprocessed_final_routes.size(); ++i) {
-      for(unsigned j = 0; j < postprocessed_final_routes[i].size(); ++j) {
-        unsigned curr_node = postprocessed_final_routes[i][j];
-        unsigned best_candidate = UINT_MAX;
-        unsigned best_candidate_route = UINT_MAX;
-        unsigned best_candidate_pos_in_route = UINT_MAX;
-        unsigned best_curr_pos_in_route = UINT_MAX;
-        double max_reduction_in_cost = 0.0;
-        for(unsigned k = 0; k < postprocessed_final_routes.size(); ++k) {
-          if(k == i) continue;
-          for(unsigned l = 0; l < postprocessed_final_routes[k].size(); ++l) {
-            unsigned candidate_node = postprocessed_final_routes[k][l];
-            bool exchange_feasible = isFeasible(postprocessed_final_routes[i], postprocessed_final_routes[k], curr_node, candidate_node, capacity, points);
-            if (!exchange_feasible) continue;
-            double route_cost_before_exchange = get_cost_of_route(postprocessed_final_routes[i], points) + get_cost_of_route(postprocessed_final_routes[k], points);
-            unsigned curr_pos;
-            if(postprocessed_final_routes[i].size() == 1) {
-              postprocessed_final_routes[i][j] = candidate_node;
-              postprocessed_final_routes[k][l] = curr_node;
-            }
-            else {
-              postprocessed_final_routes[k][l] = curr_node;
-              postprocessed_final_routes[i].erase (postprocessed_final_routes[i].begin() + j);
-              double curr_inc = get_best_position_in_route (postprocessed_final_routes[i], points, curr_pos, candidate_node);
-              postprocessed_final_routes[i].insert(postprocessed_final_routes[i].begin() + curr_pos + 1, candidate_node);
-            }
-            double route_cost_after_exchange = get_cost_of_route(postprocessed_final_routes[i], points) + get_cost_of_route(postprocessed_final_routes[k], points);
-            if(postprocessed_final_routes[i].size() == 1) {
-              postprocessed_final_routes[i][j] = curr_node;
-              postprocessed_final_routes[k][l] = candidate_node;
-            }
-            else {
-              postprocessed_final_routes[i].erase(postprocessed_final_routes[i].begin() + curr_pos + 1);
-              postprocessed_final_routes[i].insert (postprocessed_final_routes[i].begin() + j, curr_node);
-              postprocessed_final_routes[k][l] = candidate_node;
-            }
-            if ((route_cost_before_exchange - route_cost_after_exchange) > max_reduction_in_cost) {
-              best_candidate = candidate_node;
-              best_candidate_route = k;
-              best_candidate_pos_in_route = l;
-              best_curr_pos_in_route = curr_pos;
-              max_reduction_in_cost = route_cost_before_exchange - route_cost_after_exchange;
+    for(unsigned r = 0; r < routes.size(); ++r) {
+      for(unsigned s = r+1; s < routes.size(); ++s) {
+        if (!rs.may_interact(r, s)) continue;
+        rs.preprocess_insertions(r, s, best_in_s);
+        rs.preprocess_insertions(s, r, best_in_r);
+        unsigned best_j = UINT_MAX, best_k = UINT_MAX;
+        unsigned best_after_u = UINT_MAX, best_after_v = UINT_MAX;
+        double max_reduction_in_cost = MIN_REDUCTION_IN_COST;
+        for(unsigned j = 0; j < routes[r].size(); ++j) {
+          unsigned u = routes[r].nodes[j];
+          double u_removal_gain = rs.removal_gain(r, j);
+          for(unsigned k = 0; k < routes[s].size(); ++k) {
+            unsigned v = routes[s].nodes[k];
+            if (routes[r].load - points.demands[u] + points.demands[v] > capacity) continue;
+            if (routes[s].load - points.demands[v] + points.demands[u] > capacity) continue;
+            double reduction_in_cost = u_removal_gain + rs.removal_gain(s, k);
+            unsigned after_u, after_v;
+            reduction_in_cost -= rs.swap_insertion(best_in_s[j], u, s, k, after_u);
+            reduction_in_cost -= rs.swap_insertion(best_in_r[k], v, r, j, after_v);
+            if (reduction_in_cost > max_reduction_in_cost) {
+              max_reduction_in_cost = reduction_in_cost;
+              best_j = j;
+              best_k = k;
+              best_after_u = after_u;
+              best_after_v = after_v;
             }
           }
         }
-        if(best_candidate < UINT_MAX) {
-          if(postprocessed_final_routes[i].size() == 1) {
-            postprocessed_final_routes[i][j] = best_candidate;
-            postprocessed_final_routes[best_candidate_route][best_candidate_pos_in_route] = curr_node;
-          }
-          else if(postprocessed_final_routes[i].size() > 1) {
-            postprocessed_final_routes[best_candidate_route][best_candidate_pos_in_route] = curr_node;
-            postprocessed_final_routes[i].erase (postprocessed_final_routes[i].begin() + j);
-            postprocessed_final_routes[i].insert(postprocessed_final_routes[i].begin() + best_curr_pos_in_route + 1, best_candidate);
-          }
+        if (best_j < UINT_MAX) {
+          unsigned u = routes[r].nodes[best_j], v = routes[s].nodes[best_k];
+          rs.replace(r, best_j, v, best_after_v);
+          rs.replace(s, best_k, u, best_after_u);
           anotherIter = true;
         }
       }
     }
   }while(anotherIter);
+  rs.write_back(postprocessed_final_routes);
 }
 vector<vector<unsigned> > remove_single_node_routes (vector<vector<unsigned> >& postprocessed_final_routes, unsigned capacity, Points& points) {
 #if 1
-  vector<bool> route_omit (postprocessed_final_routes.size(), false);
+  RouteSet rs (postprocessed_final_routes, points);
+  vector<Route>& routes = rs.routes;
+  vector<bool> route_omit (routes.size(), false);
   vector<pair<unsigned, unsigned> > vec_isolated_node;
-  for(unsigned i = 0; i < postprocessed_final_routes.size(); ++i) {
-    if(postprocessed_final_routes[i].size() == 1) {
-      vec_isolated_node.push_back(make_pair(points.demands[postprocessed_final_routes[i][0]], i));
+  for(unsigned i = 0; i < routes.size(); ++i) {
+    if(routes[i].size() == 1) {
+      vec_isolated_node.push_back(make_pair(points.demands[routes[i].nodes[0]], i));
     }
   }
   sort (vec_isolated_node.begin(), vec_isolated_node.end());
@@ -953,44 +1310,215 @@ vector<vector<unsigned> > remove_single_node_routes (vector<vector<unsigned> >&
   }
   for(unsigned i = 0; i < route_ordering.size(); ++i) {
     unsigned curr_route_id = route_ordering[i];
-    if (postprocessed_final_routes[curr_route_id].size() > 1) continue;
-    unsigned curr_node = postprocessed_final_routes[curr_route_id][0];
+    if (routes[curr_route_id].size() > 1) continue;
+    unsigned curr_node = routes[curr_route_id].nodes[0];
     unsigned best_route = UINT_MAX;
     unsigned best_pos_in_best_route = UINT_MAX;
     double max_reduction_in_cost = 0.0;
-    for(unsigned k = 0; k < postprocessed_final_routes.size(); ++k) {
+    for(unsigned k = 0; k < routes.size(); ++k) {
       unsigned route_id1 = k;
       if(route_omit[route_id1]) continue;
       if(route_id1 == curr_route_id) continue;
-      bool exchange_feasible = isFeasible(postprocessed_final_routes[route_id1], curr_node, capacity, points);
-      if (!exchange_feasible) continue;
-      double route_cost_before = get_cost_of_route(postprocessed_final_routes[curr_route_id], points) + get_cost_of_route(postprocessed_final_routes[route_id1], points);
+      if (routes[route_id1].load + points.demands[curr_node] > capacity) continue;
       unsigned curr_pos;
-      double curr_inc = get_best_position_in_route (postprocessed_final_routes[route_id1], points, curr_pos, curr_node);
-      auto itr = postprocessed_final_routes[route_id1].begin() + curr_pos + 1;
-      postprocessed_final_routes[route_id1].insert(itr,curr_node);
-      double route_cost_after = get_cost_of_route(postprocessed_final_routes[route_id1], points);
-      postprocessed_final_routes[route_id1].erase (postprocessed_final_routes[route_id1].begin() + curr_pos + 1);
-      if ((route_cost_before - route_cost_after) > max_reduction_in_cost) {
+      double curr_inc = rs.best_insertion(route_id1, curr_node, curr_pos);
+      if ((routes[curr_route_id].cost - curr_inc) > max_reduction_in_cost) {
         best_route = route_id1;
         best_pos_in_best_route = curr_pos;
-        max_reduction_in_cost = route_cost_before - route_cost_after;
+        max_reduction_in_cost = routes[curr_route_id].cost - curr_inc;
       }
     }
     if(best_route < UINT_MAX) {
-      auto it = postprocessed_final_routes[best_route].begin() + best_pos_in_best_route + 1;
-      postprocessed_final_routes[best_route].insert(it,curr_node);
+      rs.relocate(curr_route_id, 0, best_route, best_pos_in_best_route + 1);
       route_omit[curr_route_id] = true;
     }
   }
   vector<vector<unsigned> > postprocessed_final_routes_new;
-  for(unsigned xyz = 0; xyz < postprocessed_final_routes.size(); ++xyz) {
+  for(unsigned xyz = 0; xyz < routes.size(); ++xyz) {
     if(route_omit[xyz]) continue;
-    postprocessed_final_routes_new.push_back(postprocessed_final_routes[xyz]);
+    postprocessed_final_routes_new.push_back(routes[xyz].nodes);
   }
   return postprocessed_final_routes_new;
 #endif
 }
+// Best inter-route move between two routes, as priced by best_pair_move
+enum MoveType { RELOCATE, SWAP_STAR, TWO_OPT_STAR };
+struct PairMove {
+  double gain;     // reduction in cost, 0 if no improving move
+  MoveType type;
+  unsigned r, j;   // RELOCATE: routes[r].nodes[j] goes to index k of route s
+  unsigned s, k;   // SWAP_STAR: routes[r].nodes[j] and routes[s].nodes[k] swap; TWO_OPT_STAR: cut after j and k
+  unsigned after_u, after_v;  // SWAP_STAR: insertion points in s and r
+};
+// Best relocate of a customer of route r (which keeps at least one) into route s. With candidate
+// lists the customer only goes right before or after one of its nearest customers that lies in s.
+void best_relocate (const RouteSet& rs, unsigned r, unsigned s, unsigned capacity, PairMove& best) {
+  Points& points = rs.points;
+  const vector<Route>& routes = rs.routes;
+  if (routes[r].size() < 2) return;
+  for(unsigned j = 0; j < routes[r].size(); ++j) {
+    unsigned u = routes[r].nodes[j];
+    if (routes[s].load + points.demands[u] > capacity) continue;
+    double u_removal_gain = rs.removal_gain(r, j);
+    if (points.num_neighbours == 0) {
+      unsigned pos;
+      double reduction_in_cost = u_removal_gain - rs.best_insertion(s, u, pos);
+      if (reduction_in_cost > best.gain) {
+        best.gain = reduction_in_cost;
+        best.type = RELOCATE; best.r = r; best.j = j; best.s = s; best.k = pos + 1;
+      }
+      continue;
+    }
+    for(unsigned kk = 0; kk < points.num_neighbours; ++kk) {
+      unsigned w = points.neighbours[u*points.num_neighbours + kk];
+      if (rs.route_of[w] != s) continue;
+      for(unsigned idx = rs.pos_of[w]; idx <= rs.pos_of[w] + 1; ++idx) {
+        double reduction_in_cost = u_removal_gain - rs.insertion_cost(s, idx, u);
+        if (reduction_in_cost > best.gain) {
+          best.gain = reduction_in_cost;
+          best.type = RELOCATE; best.r = r; best.j = j; best.s = s; best.k = idx;
+        }
+      }
+    }
+  }
+}
+// Best SWAP* between routes r and s (see swap_star); it also covers the plain exchange in place
+void best_swap_star (const RouteSet& rs, unsigned r, unsigned s, unsigned capacity, PairMove& best, vector<ThreeBestInsert>& best_in_s, vector<ThreeBestInsert>& best_in_r) {
+  Points& points = rs.points;
+  const vector<Route>& routes = rs.routes;
+  rs.preprocess_insertions(r, s, best_in_s);
+  rs.preprocess_insertions(s, r, best_in_r);
+  for(unsigned j = 0; j < routes[r].size(); ++j) {
+    unsigned u = routes[r].nodes[j];
+    double u_removal_gain = rs.removal_gain(r, j);
+    for(unsigned k = 0; k < routes[s].size(); ++k) {
+      unsigned v = routes[s].nodes[k];
+      if (routes[r].load - points.demands[u] + points.demands[v] > capacity) continue;
+      if (routes[s].load - points.demands[v] + points.demands[u] > capacity) continue;
+      unsigned after_u, after_v;
+      double reduction_in_cost = u_removal_gain + rs.removal_gain(s, k);
+      reduction_in_cost -= rs.swap_insertion(best_in_s[j], u, s, k, after_u);
+      reduction_in_cost -= rs.swap_insertion(best_in_r[k], v, r, j, after_v);
+      if (reduction_in_cost > best.gain) {
+        best.gain = reduction_in_cost;
+        best.type = SWAP_STAR; best.r = r; best.j = j; best.s = s; best.k = k;
+        best.after_u = after_u; best.after_v = after_v;
+      }
+    }
+  }
+}
+// Best relocate (either way), SWAP* or 2-opt* move between routes r and s. Reads the routes only.
+PairMove best_pair_move (const RouteSet& rs, unsigned r, unsigned s, unsigned capacity, vector<ThreeBestInsert>& buf1, vector<ThreeBestInsert>& buf2) {
+  PairMove best;
+  best.gain = MIN_REDUCTION_IN_COST;
+  best_relocate (rs, r, s, capacity, best);
+  best_relocate (rs, s, r, capacity, best);
+  best_swap_star (rs, r, s, capacity, best, buf1, buf2);
+  if (rs.routes[r].size() > 1 && rs.routes[s].size() > 1) {
+    unsigned ii, jj;
+    double change = best_inter_route_2opt (rs, r, s, capacity, ii, jj);
+    if (-change > best.gain) {
+      best.gain = -change;
+      best.type = TWO_OPT_STAR; best.r = r; best.j = ii; best.s = s; best.k = jj;
+    }
+  }
+  if (best.gain == MIN_REDUCTION_IN_COST) best.gain = 0.0;
+  return best;
+}
+void apply_pair_move (RouteSet& rs, const PairMove& m) {
+  if (m.type == RELOCATE) {
+    rs.relocate(m.r, m.j, m.s, m.k);
+  }
+  else if (m.type == SWAP_STAR) {
+    unsigned u = rs.routes[m.r].nodes[m.j], v = rs.routes[m.s].nodes[m.k];
+    rs.replace(m.r, m.j, v, m.after_v);
+    rs.replace(m.s, m.k, u, m.after_u);
+  }
+  else {
+    apply_inter_route_2opt (rs, m.r, m.s, m.j, m.k);
+  }
+}
+// Inter-route local search (relocate, SWAP*, 2-opt*) by best improvement over a queue of moves.
+// The best move of every route pair for which RouteSet::may_interact holds is priced once and
+// queued by gain. Applying a move only re-prices the pairs that contain one of its two routes;
+// a pair keeps one slot, overwritten when it is re-priced. Queued moves priced before their slot
+// was overwritten or one of their routes last changed are dropped lazily, and the queue is rebuilt
+// from the slots once they outnumber the live ones. Stops at a local optimum, when no queued move
+// is left.
+void inter_route_search (vector<vector<unsigned> >& postprocessed_final_routes, unsigned capacity, Points& points) {
+  RouteSet rs (postprocessed_final_routes, points);
+  unsigned nroutes = rs.routes.size();
+  vector<PairMove> moves;  // the last move priced for every pair that had an improving one
+  vector<unsigned> moves_priced_at;
+  unordered_map<unsigned, unsigned> slot_of;  // pair -> index in moves
+  vector<unsigned> changed_at (nroutes, 0);  // number of moves applied when the route last changed
+  unsigned applied = 0;
+  typedef tuple<double, unsigned, unsigned, unsigned> Queued;  // {gain, pair r * nroutes + s, priced at, slot}
+  priority_queue<Queued> queue;
+  auto live = [&](const Queued& q) {
+    unsigned k = get<3>(q);
+    return get<2>(q) == moves_priced_at[k] && max(changed_at[moves[k].r], changed_at[moves[k].s]) <= get<2>(q);
+  };
+  vector<unsigned> route_pairs;  // pairs to price, r * nroutes + s with r < s
+  vector<PairMove> priced;
+  for(unsigned r = 0; r < nroutes; ++r)
+    for(unsigned s = r+1; s < nroutes; ++s)
+      if (rs.may_interact(r, s)) route_pairs.push_back(r * nroutes + s);
+  while (true) {
+    unsigned npairs = route_pairs.size();
+    priced.resize(npairs);
+    #pragma omp parallel
+    {
+      vector<ThreeBestInsert> buf1, buf2;
+      #pragma omp for schedule(dynamic, 4)
+      for(unsigned p = 0; p < npairs; ++p) {
+        unsigned rs_id = route_pairs[p];
+        priced[p] = best_pair_move (rs, rs_id / nroutes, rs_id % nroutes, capacity, buf1, buf2);
+      }
+    }
+    for(unsigned p = 0; p < npairs; ++p) {
+      auto it = slot_of.find(route_pairs[p]);
+      if (it == slot_of.end()) {
+        if (priced[p].gain <= 0.0) continue;
+        it = slot_of.emplace(route_pairs[p], moves.size()).first;
+        moves.push_back(priced[p]);
+        moves_priced_at.push_back(applied);
+      }
+      unsigned k = it->second;
+      moves[k] = priced[p];  // a move that no longer improves keeps its slot, with gain 0
+      moves_priced_at[k] = applied;
+      if (priced[p].gain > 0.0) queue.push(make_tuple(priced[p].gain, route_pairs[p], applied, k));
+    }
+    // Every slot has at most one live entry, so past 2 * moves.size() most of the queue is stale
+    if (queue.size() > 2 * moves.size()) {
+      priority_queue<Queued> rebuilt;
+      for(unsigned k = 0; k < moves.size(); ++k) {
+        const PairMove& m = moves[k];
+        if (m.gain <= 0.0) continue;
+        Queued q = make_tuple(m.gain, min(m.r, m.s) * nroutes + max(m.r, m.s), moves_priced_at[k], k);
+        if (live(q)) rebuilt.push(q);
+      }
+      swap(queue, rebuilt);
+    }
+    while (!queue.empty() && !live(queue.top()))
+      queue.pop();
+    if (queue.empty()) break;
+    const PairMove m = moves[get<3>(queue.top())];
+    queue.pop();
+    unsigned r = m.r, s = m.s;
+    apply_pair_move (rs, m);
+    ++applied;
+    changed_at[r] = changed_at[s] = applied;
+    route_pairs.clear();
+    for(unsigned t = 0; t < nroutes; ++t) {
+      for(unsigned x : {r, s}) {
+        if (t == x || (x == s && t == r)) continue;  // (r, s) is taken with x == r
+        if (rs.may_interact(t, x)) route_pairs.push_back(min(t, x) * nroutes + max(t, x));
+      }
+    }
+  }
+  rs.write_back(postprocessed_final_routes);
+}
 vector<vector<unsigned> > intra_route_TSP (vector<vector<unsigned> >& final_routes, Points& points) {
   vector<vector<unsigned> > postprocessed_final_routes1 = postprocess_tsp_approx (final_routes, points);
   vector<vector<unsigned> > postprocessed_final_routes2 = postprocess_2OPT (postprocessed_final_routes1, points);
@@ -1054,37 +1582,9 @@ vector<vector<unsigned> > sci_heuristic (Points& points, unsigned capacity, unsi
   else if (dimension - 1 <= 1500) numIter = 15;
   else if ((dimension - 1 > 1500) && (dimension-1 <= 12000)) numIter = 15;
   else if ((dimension - 1 > 12000) && (dimension-1 < 20000)) numIter = 10;
-  unsigned best_cost_function = UINT_MAX;
-  unsigned best_ordering = UINT_MAX;
+  vector<vector<unsigned> > orderings(numIter);  // orderings[numTry-1]: node ordering of that try
   for(unsigned numTry = 1; numTry <=numIter; ++numTry) {
-    vector<vector <unsigned> > semi_final_routes;
-    double semi_final_total_cost = DBL_MAX;
-    unsigned semi_best_cost_function = UINT_MAX;
-    for(unsigned ii=0; ii <= 7; ++ii) {
-      vector<vector <unsigned> > final_routes_temp;
-      double total_cost_temp = DBL_MAX;
-      for(unsigned kk = 0; kk < theta_vec.size(); ++kk) {
-        vector<vector <unsigned> > final_routes_theta_temp;
-        unsigned ca = theta_vec[kk];
-        populate_routes (points, node_order, shuffled_order, capacity, final_routes_theta_temp, ii, ca);
-        double total_cost_theta_temp = get_total_cost_of_routes (final_routes_theta_temp, points);
-        if(total_cost_theta_temp < total_cost_temp) {
-          total_cost_temp = total_cost_theta_temp;
-          final_routes_temp = final_routes_theta_temp;
-        }
-      }
-      if(total_cost_temp < semi_final_total_cost) {
-        semi_final_total_cost = total_cost_temp;
-        semi_final_routes = final_routes_temp;
-        semi_best_cost_function = ii;
-      }
-    }
-    if(semi_final_total_cost < final_total_cost) {
-      final_total_cost = semi_final_total_cost;
-      final_routes = semi_final_routes;
-      best_cost_function = semi_best_cost_function;
-      best_ordering = numTry;
-    }
+    orderings[numTry-1].assign(shuffled_order, shuffled_order + dimension-1);
     if(numTry == 2) {
       for(unsigned i=0; i < dimension-1; ++i)
         shuffled_order[i] = node_order[dimension-2-i];
@@ -1096,123 +1596,47 @@ vector<vector<unsigned> > sci_heuristic (Points& points, unsigned capacity, unsi
     if(numTry >= 4)
       shuffle(shuffled_order, dimension-1);
   }
+  // All (ordering, cost function, cone angle) constructions are independent. Task t is the t-th one
+  // of the serial sweep; ties in cost go to the lowest t, so the winner does not depend on the schedule.
+  const unsigned first_cost_func = 0, num_cost_funcs = 8 - first_cost_func;
+  const unsigned num_angles = theta_vec.size();
+  const unsigned num_tasks = numIter * num_cost_funcs * num_angles;
+  unsigned best_task = UINT_MAX;
+  #pragma omp parallel
+  {
+    vector<vector <unsigned> > local_routes;
+    double local_cost = DBL_MAX;
+    unsigned local_task = UINT_MAX;
+    #pragma omp for schedule(dynamic, 1) nowait
+    for(unsigned t = 0; t < num_tasks; ++t) {
+      unsigned numTry = t / (num_cost_funcs * num_angles);
+      unsigned ii = first_cost_func + t / num_angles % num_cost_funcs;
+      unsigned kk = t % num_angles;
+      vector<vector <unsigned> > final_routes_theta_temp;
+      populate_routes (points, node_order, orderings[numTry].data(), capacity, final_routes_theta_temp, ii, theta_vec[kk]);
+      double total_cost_theta_temp = get_total_cost_of_routes (final_routes_theta_temp, points);
+      if(total_cost_theta_temp < local_cost || (total_cost_theta_temp == local_cost && t < local_task)) {
+        local_cost = total_cost_theta_temp;
+        local_task = t;
+        local_routes.swap(final_routes_theta_temp);
+      }
+    }
+    #pragma omp critical
+    if(local_cost < final_total_cost || (local_cost == final_total_cost && local_task < best_task)) {
+      final_total_cost = local_cost;
+      best_task = local_task;
+      final_routes.swap(local_routes);
+    }
+  }
+  unsigned best_cost_function = first_cost_func + best_task / num_angles % num_cost_funcs;
+  unsigned best_ordering = best_task / (num_cost_funcs * num_angles) + 1;
   cout << "(Cost-function, node_ordering) that gave the best result for SCI = (" << best_cost_function << ", " << best_ordering << ")" << endl;
   vector<vector<unsigned> > postprocessed_final_routes = intra_route_TSP(final_routes, points);
   double n_cost = DBL_MAX;
   double o_cost = DBL_MAX;
   do {
     o_cost = n_cost;
-#if 1
-    bool anotherIter;
-    do {
-      anotherIter = false;
-      vector<pair<unsigned, unsigned> > vec_isolated_node;
-      vector<pair<unsigned, unsigned> > vec_route;
-      for(unsigned i = 0; i < postprocessed_final_routes.size(); ++i) {
-        if(postprocessed_final_routes[i].size() == 1) {
-          vec_isolated_node.push_back(make_pair(points.demands[postprocessed_final_routes[i][0]], i));
-        }
-        else if (postprocessed_final_routes[i].size() > 1) {
-          vec_route.push_back(make_pair(postprocessed_final_routes[i].size(), i));
-        }
-      }
-      sort (vec_route.rbegin(), vec_route.rend());
-      sort (vec_isolated_node.begin(), vec_isolated_node.end());
-      vector<unsigned> route_ordering (postprocessed_final_routes.size());
-      unsigned route_counter = 0;
-      for(unsigned i = 0; i < vec_isolated_node.size(); ++i) {
-        route_ordering[route_counter] = vec_isolated_node[i].second;
-        ++route_counter;
-      }
-      for(unsigned i = 0; i < vec_route.size(); ++i) {
-        route_ordering[route_counter] = vec_route[i].second;
-        ++route_counter;
-      }
-      vector<bool> route_omit (postprocessed_final_routes.size(), false);
-      for(unsigned i = 0; i < postprocessed_final_routes.size(); ++i) {
-        unsigned curr_route_id = route_ordering[i];
-        if (postprocessed_final_routes[curr_route_id].size() == 1) continue;
-        for(unsigned j = 0; j < postprocessed_final_routes[curr_route_id].size(); ++j) {
-          unsigned curr_node = postprocessed_final_routes[curr_route_id][j];
-          unsigned best_route = UINT_MAX;
-          unsigned best_pos_in_best_route = UINT_MAX;
-          double max_reduction_in_cost = 0.0;
-          for(unsigned k = 0; k < postprocessed_final_routes.size(); ++k) {
-            unsigned route_id1 = route_ordering[postprocessed_final_routes.size()-k-1];
-            if(route_id1 == curr_route_id) continue;
-            bool exchange_feasible = isFeasible(postprocessed_final_routes[route_id1], curr_node, capacity, points);
-            if (!exchange_feasible) continue;
-            double route_cost_before = get_cost_of_route(postprocessed_final_routes[curr_route_id], points) + get_cost_of_route(postprocessed_final_routes[route_id1], points);
-            unsigned curr_pos;
-            double curr_inc = get_best_position_in_route (postprocessed_final_routes[route_id1], points, curr_pos, curr_node);
-            vector<unsigned> temp_partial_curr_route;
-            for(unsigned zz = 0; zz < postprocessed_final_routes[curr_route_id].size(); ++zz) {
-              if(postprocessed_final_routes[curr_route_id][zz] == curr_node) continue;
-              temp_partial_curr_route.push_back(postprocessed_final_routes[curr_route_id][zz]);
-            }
-            auto itr = postprocessed_final_routes[route_id1].begin() + curr_pos + 1;
-            postprocessed_final_routes[route_id1].insert(itr,curr_node);
-            double route_cost_after = get_cost_of_route(temp_partial_curr_route, points) + get_cost_of_route(postprocessed_final_routes[route_id1], points);
-            postprocessed_final_routes[route_id1].erase (postprocessed_final_routes[route_id1].begin() + curr_pos + 1);
-            if ((route_cost_before - route_cost_after) > max_reduction_in_cost) {
-              best_route = route_id1;
-              best_pos_in_best_route = curr_pos;
-              max_reduction_in_cost = route_cost_before - route_cost_after;
-            }
-          }
-          if(best_route < UINT_MAX) {
-            auto it = postprocessed_final_routes[best_route].begin() + best_pos_in_best_route + 1;
-            postprocessed_final_routes[best_route].insert(it,curr_node);
-            postprocessed_final_routes[curr_route_id].erase (postprocessed_final_routes[curr_route_id].begin()+j);
-            anotherIter = true;
-          }
-        }
-      }
-    }while(anotherIter);
-#endif
-    do {
-      anotherIter = false;
-      for(unsigned i = 0; i < postprocessed_final_routes.size(); ++i) {
-        for(unsigned j = 0; j < postprocessed_final_routes[i].size(); ++j) {
-          unsigned curr_node = postprocessed_final_routes[i][j];
-          unsigned best_candidate = UINT_MAX;
-          unsigned best_candidate_route = UINT_MAX;
-          unsigned best_candidate_pos_in_route = UINT_MAX;
-          double max_reduction_in_cost = 0;
-          for(unsigned k = 0; k < postprocessed_final_routes.size(); ++k) {
-            if(k == i) continue;
-            for(unsigned l = 0; l < postprocessed_final_routes[k].size(); ++l) {
-              unsigned candidate_node = postprocessed_final_routes[k][l];
-              bool exchange_feasible = isFeasible(postprocessed_final_routes[i], postprocessed_final_routes[k], curr_node, candidate_node, capacity, points);
-              if (!exchange_feasible) continue;
-              double route_cost_before_exchange = get_cost_of_route(postprocessed_final_routes[i], points) + get_cost_of_route(postprocessed_final_routes[k], points);
-              postprocessed_final_routes[i][j] = candidate_node;
-              postprocessed_final_routes[k][l] = curr_node;
-              double route_cost_after_exchange = get_cost_of_route(postprocessed_final_routes[i], points) + get_cost_of_route(postprocessed_final_routes[k], points);
-              postprocessed_final_routes[i][j] = curr_node;
-              postprocessed_final_routes[k][l] = candidate_node;
-              if ((route_cost_before_exchange - route_cost_after_exchange) > max_reduction_in_cost) {
-                best_candidate = candidate_node;
-                best_candidate_route = k;
-                best_candidate_pos_in_route = l;
-                max_reduction_in_cost = route_cost_before_exchange - route_cost_after_exchange;
-              }
-            }
-          }
-          if(best_candidate < UINT_MAX) {
-            postprocessed_final_routes[i][j] = best_candidate;
-            postprocessed_final_routes[best_candidate_route][best_candidate_pos_in_route] = curr_node;
-            anotherIter = true;
-          }
-        }
-      }
-    }while(anotherIter);
-#if 1
-    swap_star(postprocessed_final_routes, capacity, points);
-#endif
-#if 1
-    Two_opt_star (postprocessed_final_routes, capacity, points);
-#endif
+    inter_route_search (postprocessed_final_routes, capacity, points);
 #if 1
     vector<vector<unsigned> > postprocessed_final_routes_temp = postprocess_2OPT (postprocessed_final_routes, points);
     postprocessed_final_routes = postprocessed_final_routes_temp;
@@ -1287,117 +1711,7 @@ vector<vector<unsigned> > sci_heuristic1 (Points& points, unsigned capacity, uns
   double o_cost = DBL_MAX;
   do {
     o_cost = n_cost;
-#if 1
-    bool anotherIter;
-    do {
-      anotherIter = false;
-      vector<pair<unsigned, unsigned> > vec_isolated_node;
-      vector<pair<unsigned, unsigned> > vec_route;
-      for(unsigned i = 0; i < postprocessed_final_routes.size(); ++i) {
-        if(postprocessed_final_routes[i].size() == 1) {
-          vec_isolated_node.push_back(make_pair(points.demands[postprocessed_final_routes[i][0]], i));
-        }
-        else if (postprocessed_final_routes[i].size() > 1) {
-          vec_route.push_back(make_pair(postprocessed_final_routes[i].size(), i));
-        }
-      }
-      sort (vec_route.rbegin(), vec_route.rend());
-      sort (vec_isolated_node.begin(), vec_isolated_node.end());
-      vector<unsigned> route_ordering (postprocessed_final_routes.size());
-      unsigned route_counter = 0;
-      for(unsigned i = 0; i < vec_isolated_node.size(); ++i) {
-        route_ordering[route_counter] = vec_isolated_node[i].second;
-        ++route_counter;
-      }
-      for(unsigned i = 0; i < vec_route.size(); ++i) {
-        route_ordering[route_counter] = vec_route[i].second;
-        ++route_counter;
-      }
-      vector<bool> route_omit (postprocessed_final_routes.size(), false);
-      for(unsigned i = 0; i < postprocessed_final_routes.size(); ++i) {
-        unsigned curr_route_id = route_ordering[i];
-        if (postprocessed_final_routes[curr_route_id].size() == 1) continue;
-        for(unsigned j = 0; j < postprocessed_final_routes[curr_route_id].size(); ++j) {
-          unsigned curr_node = postprocessed_final_routes[curr_route_id][j];
-          unsigned best_route = UINT_MAX;
-          unsigned best_pos_in_best_route = UINT_MAX;
-          double max_reduction_in_cost = 0.0;
-          for(unsigned k = 0; k < postprocessed_final_routes.size(); ++k) {
-            unsigned route_id1 = route_ordering[postprocessed_final_routes.size()-k-1];
-            if(route_id1 == curr_route_id) continue;
-            bool exchange_feasible = isFeasible(postprocessed_final_routes[route_id1], curr_node, capacity, points);
-            if (!exchange_feasible) continue;
-            double route_cost_before = get_cost_of_route(postprocessed_final_routes[curr_route_id], points) + get_cost_of_route(postprocessed_final_routes[route_id1], points);
-            unsigned curr_pos;
-            double curr_inc = get_best_position_in_route (postprocessed_final_routes[route_id1], points, curr_pos, curr_node);
-            vector<unsigned> temp_partial_curr_route;
-            for(unsigned zz = 0; zz < postprocessed_final_routes[curr_route_id].size(); ++zz) {
-              if(postprocessed_final_routes[curr_route_id][zz] == curr_node) continue;
-              temp_partial_curr_route.push_back(postprocessed_final_routes[curr_route_id][zz]);
-            }
-            auto itr = postprocessed_final_routes[route_id1].begin() + curr_pos + 1;
-            postprocessed_final_routes[route_id1].insert(itr,curr_node);
-            double route_cost_after = get_cost_of_route(temp_partial_curr_route, points) + get_cost_of_route(postprocessed_final_routes[route_id1], points);
-            postprocessed_final_routes[route_id1].erase (postprocessed_final_routes[route_id1].begin() + curr_pos + 1);
-            if ((route_cost_before - route_cost_after) > max_reduction_in_cost) {
-              best_route = route_id1;
-              best_pos_in_best_route = curr_pos;
-              max_reduction_in_cost = route_cost_before - route_cost_after;
-            }
-          }
-          if(best_route < UINT_MAX) {
-            auto it = postprocessed_final_routes[best_route].begin() + best_pos_in_best_route + 1;
-            postprocessed_final_routes[best_route].insert(it,curr_node);
-            postprocessed_final_routes[curr_route_id].erase (postprocessed_final_routes[curr_route_id].begin()+j);
-            anotherIter = true;
-          }
-        }
-      }
-    }while(anotherIter);
-#endif
-    do {
-      anotherIter = false;
-      for(unsigned i = 0; i < postprocessed_final_routes.size(); ++i) {
-        for(unsigned j = 0; j < postprocessed_final_routes[i].size(); ++j) {
-          unsigned curr_node = postprocessed_final_routes[i][j];
-          unsigned best_candidate = UINT_MAX;
-          unsigned best_candidate_route = UINT_MAX;
-          unsigned best_candidate_pos_in_route = UINT_MAX;
-          double max_reduction_in_cost = 0;
-          for(unsigned k = 0; k < postprocessed_final_routes.size(); ++k) {
-            if(k == i) continue;
-            for(unsigned l = 0; l < postprocessed_final_routes[k].size(); ++l) {
-              unsigned candidate_node = postprocessed_final_routes[k][l];
-              bool exchange_feasible = isFeasible(postprocessed_final_routes[i], postprocessed_final_routes[k], curr_node, candidate_node, capacity, points);
-              if (!exchange_feasible) continue;
-              double route_cost_before_exchange = get_cost_of_route(postprocessed_final_routes[i], points) + get_cost_of_route(postprocessed_final_routes[k], points);
-              postprocessed_final_routes[i][j] = candidate_node;
-              postprocessed_final_routes[k][l] = curr_node;
-              double route_cost_after_exchange = get_cost_of_route(postprocessed_final_routes[i], points) + get_cost_of_route(postprocessed_final_routes[k], points);
-              postprocessed_final_routes[i][j] = curr_node;
-              postprocessed_final_routes[k][l] = candidate_node;
-              if ((route_cost_before_exchange - route_cost_after_exchange) > max_reduction_in_cost) {
-                best_candidate = candidate_node;
-                best_candidate_route = k;
-                best_candidate_pos_in_route = l;
-                max_reduction_in_cost = route_cost_before_exchange - route_cost_after_exchange;
-              }
-            }
-          }
-          if(best_candidate < UINT_MAX) {
-            postprocessed_final_routes[i][j] = best_candidate;
-            postprocessed_final_routes[best_candidate_route][best_candidate_pos_in_route] = curr_node;
-            anotherIter = true;
-          }
-        }
-      }
-    }while(anotherIter);
-#if 1
-    swap_star(postprocessed_final_routes, capacity, points);
-#endif
-#if 1
-    Two_opt_star (postprocessed_final_routes, capacity, points);
-#endif
+    inter_route_search (postprocessed_final_routes, capacity, points);
 #if 1
     vector<vector<unsigned> > postprocessed_final_routes_temp = postprocess_2OPT (postprocessed_final_routes, points);
     postprocessed_final_routes = postprocessed_final_routes_temp;
@@ -1500,6 +1814,28 @@ vector<vector<Edge> > PrimsMST(Points &points, vector<vector<Edge> > & graph, un
   }
   return nG;
 }
+// Same adjacency as PrimsMST, without the complete graph: from the Delaunay triangulation in O(n log n),
+// or by Boruvka over k-d tree nearest neighbour queries (parallel when built with OpenMP).
+vector<vector<Edge> > EuclideanMST(Points &points, const string& mst) {
+  unsigned N = points.dimension;
+  vector<pair<int,int> > edges;
+  if(mst == "boruvka")
+    boruvka_mst(N, points.x_coords, points.y_coords, 0, edges);
+  else
+    euclidean_mst(N, points.x_coords, points.y_coords, edges);
+  vector<int> toEdges;
+  tree_parents(N, edges, 0, toEdges);
+  vector<vector<Edge> > nG(N);
+  for(unsigned u=0; u < N; u++){
+    if(toEdges[u] != -1){
+      unsigned v = toEdges[u];
+      double wt = points.L2_dist(u,v);
+      nG[u].push_back(Edge(v,wt));
+      nG[v].push_back(Edge(u,wt));
+    }
+  }
+  return nG;
+}
 void ShortCircutTour(vector< vector<Edge> > &g, vector <bool> &visited, unsigned u, vector<unsigned> &out){
   visited [u] = true;
   out.push_back(u);
@@ -1532,17 +1868,23 @@ convertToVrpRoutes(Points &points, vector <unsigned> &singleRoute, unsigned capa
   routes.push_back(aRoute);
   return routes;
 }
-vector<vector<unsigned> > mst_dfs_approach (Points& points, unsigned capacity) {
+vector<vector<unsigned> > mst_dfs_approach (Points& points, unsigned capacity, const string& mst) {
   unsigned dimension = points.dimension;
-  vector<vector<Edge> > G (dimension);
-  for(size_t i=0; i < dimension; ++i){
-    for(size_t j=i+1; j < dimension; ++j){
-      double wt = points.L2_dist(i,j);
-      G[i].push_back(Edge(j,wt));
-      G[j].push_back(Edge(i,wt));
+  vector<vector<Edge> > mstG;
+  if(mst == "delaunay" || mst == "boruvka") {
+    mstG = EuclideanMST(points, mst);
+  }
+  else {
+    vector<vector<Edge> > G (dimension);
+    for(size_t i=0; i < dimension; ++i){
+      for(size_t j=i+1; j < dimension; ++j){
+        double wt = points.L2_dist(i,j);
+        G[i].push_back(Edge(j,wt));
+        G[j].push_back(Edge(i,wt));
+      }
     }
+    mstG = PrimsMST(points, G, capacity);
   }
-  vector<vector<Edge> > mstG = PrimsMST(points, G, capacity);
   vector <bool> visited(mstG.size(), false);
   visited[0] = true;
   vector <unsigned> singleRoute;
@@ -1569,117 +1911,7 @@ vector<vector<unsigned> > mst_dfs_approach (Points& points, unsigned capacity) {
   double o_cost = DBL_MAX;
   do {
     o_cost = n_cost;
-#if 1
-    bool anotherIter;
-    do {
-      anotherIter = false;
-      vector<pair<unsigned, unsigned> > vec_isolated_node;
-      vector<pair<unsigned, unsigned> > vec_route;
-      for(unsigned i = 0; i < postprocessed_final_routes.size(); ++i) {
-        if(postprocessed_final_routes[i].size() == 1) {
-          vec_isolated_node.push_back(make_pair(points.demands[postprocessed_final_routes[i][0]], i));
-        }
-        else if (postprocessed_final_routes[i].size() > 1) {
-          vec_route.push_back(make_pair(postprocessed_final_routes[i].size(), i));
-        }
-      }
-      sort (vec_route.rbegin(), vec_route.rend());
-      sort (vec_isolated_node.begin(), vec_isolated_node.end());
-      vector<unsigned> route_ordering (postprocessed_final_routes.size());
-      unsigned route_counter = 0;
-      for(unsigned i = 0; i < vec_isolated_node.size(); ++i) {
-        route_ordering[route_counter] = vec_isolated_node[i].second;
-        ++route_counter;
-      }
-      for(unsigned i = 0; i < vec_route.size(); ++i) {
-        route_ordering[route_counter] = vec_route[i].second;
-        ++route_counter;
-      }
-      vector<bool> route_omit (postprocessed_final_routes.size(), false);
-      for(unsigned i = 0; i < postprocessed_final_routes.size(); ++i) {
-        unsigned curr_route_id = route_ordering[i];
-        if (postprocessed_final_routes[curr_route_id].size() == 1) continue;
-        for(unsigned j = 0; j < postprocessed_final_routes[curr_route_id].size(); ++j) {
-          unsigned curr_node = postprocessed_final_routes[curr_route_id][j];
-          unsigned best_route = UINT_MAX;
-          unsigned best_pos_in_best_route = UINT_MAX;
-          double max_reduction_in_cost = 0.0;
-          for(unsigned k = 0; k < postprocessed_final_routes.size(); ++k) {
-            unsigned route_id1 = route_ordering[postprocessed_final_routes.size()-k-1];
-            if(route_id1 == curr_route_id) continue;
-            bool exchange_feasible = isFeasible(postprocessed_final_routes[route_id1], curr_node, capacity, points);
-            if (!exchange_feasible) continue;
-            double route_cost_before = get_cost_of_route(postprocessed_final_routes[curr_route_id], points) + get_cost_of_route(postprocessed_final_routes[route_id1], points);
-            unsigned curr_pos;
-            double curr_inc = get_best_position_in_route (postprocessed_final_routes[route_id1], points, curr_pos, curr_node);
-            vector<unsigned> temp_partial_curr_route;
-            for(unsigned zz = 0; zz < postprocessed_final_routes[curr_route_id].size(); ++zz) {
-              if(postprocessed_final_routes[curr_route_id][zz] == curr_node) continue;
-              temp_partial_curr_route.push_back(postprocessed_final_routes[curr_route_id][zz]);
-            }
-            auto itr = postprocessed_final_routes[route_id1].begin() + curr_pos + 1;
-            postprocessed_final_routes[route_id1].insert(itr,curr_node);
-            double route_cost_after = get_cost_of_route(temp_partial_curr_route, points) + get_cost_of_route(postprocessed_final_routes[route_id1], points);
-            postprocessed_final_routes[route_id1].erase (postprocessed_final_routes[route_id1].begin() + curr_pos + 1);
-            if ((route_cost_before - route_cost_after) > max_reduction_in_cost) {
-              best_route = route_id1;
-              best_pos_in_best_route = curr_pos;
-              max_reduction_in_cost = route_cost_before - route_cost_after;
-            }
-          }
-          if(best_route < UINT_MAX) {
-            auto it = postprocessed_final_routes[best_route].begin() + best_pos_in_best_route + 1;
-            postprocessed_final_routes[best_route].insert(it,curr_node);
-            postprocessed_final_routes[curr_route_id].erase (postprocessed_final_routes[curr_route_id].begin()+j);
-            anotherIter = true;
-          }
-        }
-      }
-    }while(anotherIter);
-#endif
-    do {
-      anotherIter = false;
-      for(unsigned i = 0; i < postprocessed_final_routes.size(); ++i) {
-        for(unsigned j = 0; j < postprocessed_final_routes[i].size(); ++j) {
-          unsigned curr_node = postprocessed_final_routes[i][j];
-          unsigned best_candidate = UINT_MAX;
-          unsigned best_candidate_route = UINT_MAX;
-          unsigned best_candidate_pos_in_route = UINT_MAX;
-          double max_reduction_in_cost = 0;
-          for(unsigned k = 0; k < postprocessed_final_routes.size(); ++k) {
-            if(k == i) continue;
-            for(unsigned l = 0; l < postprocessed_final_routes[k].size(); ++l) {
-              unsigned candidate_node = postprocessed_final_routes[k][l];
-              bool exchange_feasible = isFeasible(postprocessed_final_routes[i], postprocessed_final_routes[k], curr_node, candidate_node, capacity, points);
-              if (!exchange_feasible) continue;
-              double route_cost_before_exchange = get_cost_of_route(postprocessed_final_routes[i], points) + get_cost_of_route(postprocessed_final_routes[k], points);
-              postprocessed_final_routes[i][j] = candidate_node;
-              postprocessed_final_routes[k][l] = curr_node;
-              double route_cost_after_exchange = get_cost_of_route(postprocessed_final_routes[i], points) + get_cost_of_route(postprocessed_final_routes[k], points);
-              postprocessed_final_routes[i][j] = curr_node;
-              postprocessed_final_routes[k][l] = candidate_node;
-              if ((route_cost_before_exchange - route_cost_after_exchange) > max_reduction_in_cost) {
-                best_candidate = candidate_node;
-                best_candidate_route = k;
-                best_candidate_pos_in_route = l;
-                max_reduction_in_cost = route_cost_before_exchange - route_cost_after_exchange;
-              }
-            }
-          }
-          if(best_candidate < UINT_MAX) {
-            postprocessed_final_routes[i][j] = best_candidate;
-            postprocessed_final_routes[best_candidate_route][best_candidate_pos_in_route] = curr_node;
-            anotherIter = true;
-          }
-        }
-      }
-    }while(anotherIter);
-#if 1
-    swap_star(postprocessed_final_routes, capacity, points);
-#endif
-#if 1
-    Two_opt_star (postprocessed_final_routes, capacity, points);
-#endif
+    inter_route_search (postprocessed_final_routes, capacity, points);
 #if 1
     vector<vector<unsigned> > postprocessed_final_routes_temp = postprocess_2OPT (postprocessed_final_routes, points);
     postprocessed_final_routes = postprocessed_final_routes_temp;
@@ -1704,7 +1936,9 @@ int main (int argc, char** argv) {
   int opt;
   string filename = "";
   bool round = false;
-  while ((opt = getopt(argc, argv, "f:r")) != -1)
+  string mst = "prim";
+  unsigned num_neighbours = 30;
+  while ((opt = getopt(argc, argv, "f:rm:k:")) != -1)
   {
     switch (opt)
     {
@@ -1714,12 +1948,22 @@ int main (int argc, char** argv) {
       case 'r':
         round = true;
         break;
+      case 'k':
+        num_neighbours = atoi(optarg);
+        break;
+      case 'm':
+        mst = string(optarg);
+        if(mst == "prim" || mst == "delaunay" || mst == "boruvka")
+          break;
+        // fall through - an unknown value prints the usage
       case 'h' :
       case '?' :
       default:
         cerr << "Usage: " << argv[0] << "\n"
           " -f : .vrp instance filename\n"
-          " -r : use distance values rounded to integers\n";
+          " -r : use distance values rounded to integers\n"
+          " -m : MST construction, prim (default), delaunay or boruvka\n"
+          " -k : nearest customers a relocated customer is put next to, also bounding the route pairs tried; 0 for every position and pair (default 30)\n";
         exit(1);
     }
   }
@@ -1727,19 +1971,23 @@ int main (int argc, char** argv) {
     cerr << "Input filename not specified!" << endl;
     cerr << "Usage: " << argv[0] << "\n"
       "\t-f : .vrp instance filename\n"
-      "\t-r : round distance to the nearest integer\n";
+      "\t-r : round distance to the nearest integer\n"
+      "\t-m : MST construction, prim (default), delaunay or boruvka\n"
+      "\t-k : nearest customers a relocated customer is put next to, also bounding the route pairs tried; 0 for every position and pair (default 30)\n";
     exit(1);
   }
   Points points;
   unsigned capacity = points.read (filename );
   points.cal_pairwise_distances();
+  points.cal_polar_index();
+  points.cal_neighbours(num_neighbours);
   unsigned dimension = points.dimension;
   chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
   double * distances_from_depot = (double*) malloc ((dimension-1) * sizeof(double));
   get_distances_from_depot (points, distances_from_depot);
   unsigned * node_order = (unsigned*) malloc ((dimension-1) * sizeof(unsigned));
   reorder_nodes (points, distances_from_depot, node_order);
-  vector<vector<unsigned> > postprocessed_final_routes_mst_dfs = mst_dfs_approach (points, capacity);
+  vector<vector<unsigned> > postprocessed_final_routes_mst_dfs = mst_dfs_approach (points, capacity, mst);
   double postprocessed_final_routes_mst_dfs_cost = get_total_cost_of_routes (postprocessed_final_routes_mst_dfs, points);
   vector<vector<unsigned> > postprocessed_final_routes_sci = sci_heuristic (points, capacity, node_order);
   double postprocessed_final_routes_sci_cost = get_total_cost_of_routes (postprocessed_final_routes_sci, points);
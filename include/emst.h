@@ -0,0 +1,641 @@
+#pragma once
+
+/*
+Euclidean minimum spanning tree in O(n log n).
+The EMST is a subgraph of the Delaunay triangulation, so the points are triangulated once
+(sweep-hull, after Delaunator) and Kruskal runs on its O(n) edges instead of the n(n-1)/2
+edges of the complete graph.
+
+boruvka_mst() is the parallel alternative (OpenMP): Boruvka rounds either over a sparse
+candidate graph or over the implicit complete graph, whose per-component nearest neighbours
+come from the k-d tree.
+
+Since rounding is monotone, a tree that is minimum for the exact lengths is also minimum
+for rounded lengths, so callers are free to weigh the returned edges either way.
+*/
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include <cmath>
+#include <cfloat>
+#include <cstddef>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "spatial-index.h"
+
+// Union-find with path halving and union by size
+class DisjointSet
+{
+    std::vector<int> parent, sz;
+
+public:
+    DisjointSet(size_t n = 0)
+    {
+        reset(n);
+    }
+
+    void reset(size_t n)
+    {
+        parent.resize(n);
+        std::iota(parent.begin(), parent.end(), 0);
+        sz.assign(n, 1);
+    }
+
+    int find(int u)
+    {
+        while(parent[u] != u)
+        {
+            parent[u] = parent[parent[u]];
+            u = parent[u];
+        }
+        return u;
+    }
+
+    // false if a and b were already in the same set
+    bool unite(int a, int b)
+    {
+        a = find(a);
+        b = find(b);
+        if(a == b) return false;
+        if(sz[a] < sz[b]) std::swap(a, b);
+        parent[b] = a;
+        sz[a] += sz[b];
+        return true;
+    }
+};
+
+// Delaunay triangulation of n distinct points (half-edge representation).
+// If all points are collinear there are no triangles and edges() is the path along the line.
+class DelaunayTriangulation
+{
+    size_t n;
+    const double* xs;
+    const double* ys;
+
+    std::vector<int> triangles;  // 3 point ids per triangle
+    std::vector<int> halfedges;  // opposite half-edge, -1 on the hull
+    std::vector<int> collinear;  // point order along the line, when there are no triangles
+
+    // Convex hull as a linked list, hashed on the angle around the seed circumcentre
+    std::vector<int> hull_prev, hull_next, hull_tri, hull_hash;
+    int hull_start = 0;
+    int hash_size = 0;
+    double cx = 0, cy = 0;
+    std::vector<int> edge_stack;
+
+    static double dist2(double ax, double ay, double bx, double by)
+    {
+        return (ax - bx) * (ax - bx) + (ay - by) * (ay - by);
+    }
+
+    // true if p, q, r turn counter clockwise
+    static bool orient(double px, double py, double qx, double qy, double rx, double ry)
+    {
+        return (qy - py) * (rx - qx) - (qx - px) * (ry - qy) < 0;
+    }
+
+    static bool in_circle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py)
+    {
+        double dx = ax - px, dy = ay - py;
+        double ex = bx - px, ey = by - py;
+        double fx = cx - px, fy = cy - py;
+        double ap = dx * dx + dy * dy;
+        double bp = ex * ex + ey * ey;
+        double cp = fx * fx + fy * fy;
+        return dx * (ey * cp - bp * fy) - dy * (ex * cp - bp * fx) + ap * (ex * fy - ey * fx) < 0;
+    }
+
+    // Squared circumradius, inf / nan for collinear points
+    static double circumradius(double ax, double ay, double bx, double by, double cx, double cy)
+    {
+        double dx = bx - ax, dy = by - ay;
+        double ex = cx - ax, ey = cy - ay;
+        double bl = dx * dx + dy * dy;
+        double cl = ex * ex + ey * ey;
+        double d = 0.5 / (dx * ey - dy * ex);
+        double x = (ey * bl - dy * cl) * d;
+        double y = (dx * cl - ex * bl) * d;
+        return x * x + y * y;
+    }
+
+    static void circumcenter(double ax, double ay, double bx, double by, double cx, double cy, double& ox, double& oy)
+    {
+        double dx = bx - ax, dy = by - ay;
+        double ex = cx - ax, ey = cy - ay;
+        double bl = dx * dx + dy * dy;
+        double cl = ex * ex + ey * ey;
+        double d = 0.5 / (dx * ey - dy * ex);
+        ox = ax + (ey * bl - dy * cl) * d;
+        oy = ay + (dx * cl - ex * bl) * d;
+    }
+
+    // Monotone in the angle of (dx, dy), in [0, 1]
+    static double pseudo_angle(double dx, double dy)
+    {
+        double s = std::fabs(dx) + std::fabs(dy);
+        if(s == 0) return 0;
+        double p = dx / s;
+        return (dy > 0 ? 3 - p : 1 + p) / 4;
+    }
+
+    int hash_key(double x, double y) const
+    {
+        return static_cast<int>(std::floor(pseudo_angle(x - cx, y - cy) * hash_size)) % hash_size;
+    }
+
+    void link(int a, int b)
+    {
+        halfedges[a] = b;
+        if(b != -1) halfedges[b] = a;
+    }
+
+    int add_triangle(int i0, int i1, int i2, int a, int b, int c)
+    {
+        int t = triangles.size();
+        triangles.push_back(i0);
+        triangles.push_back(i1);
+        triangles.push_back(i2);
+        halfedges.resize(t + 3, -1);
+        link(t, a);
+        link(t + 1, b);
+        link(t + 2, c);
+        return t;
+    }
+
+    // Flips edges until the triangles around half-edge a satisfy the Delaunay condition
+    int legalize(int a)
+    {
+        int ar = 0;
+        edge_stack.clear();
+        while(true)
+        {
+            int b = halfedges[a];
+            int a0 = a - a % 3;
+            ar = a0 + (a + 2) % 3;
+
+            if(b == -1)
+            {
+                if(edge_stack.empty()) break;
+                a = edge_stack.back();
+                edge_stack.pop_back();
+                continue;
+            }
+
+            int b0 = b - b % 3;
+            int al = a0 + (a + 1) % 3;
+            int bl = b0 + (b + 2) % 3;
+
+            int p0 = triangles[ar];
+            int pr = triangles[a];
+            int pl = triangles[al];
+            int p1 = triangles[bl];
+
+            if(in_circle(xs[p0], ys[p0], xs[pr], ys[pr], xs[pl], ys[pl], xs[p1], ys[p1]))
+            {
+                triangles[a] = p1;
+                triangles[b] = p0;
+
+                int hbl = halfedges[bl];
+                if(hbl == -1)
+                {
+                    // The flipped edge was on the hull, fix the hull's reference to it
+                    int e = hull_start;
+                    do
+                    {
+                        if(hull_tri[e] == bl)
+                        {
+                            hull_tri[e] = a;
+                            break;
+                        }
+                        e = hull_prev[e];
+                    } while(e != hull_start);
+                }
+                link(a, hbl);
+                link(b, halfedges[ar]);
+                link(ar, bl);
+
+                edge_stack.push_back(b0 + (b + 1) % 3);
+            }
+            else
+            {
+                if(edge_stack.empty()) break;
+                a = edge_stack.back();
+                edge_stack.pop_back();
+            }
+        }
+        return ar;
+    }
+
+    void triangulate()
+    {
+        if(n < 3)
+        {
+            for(size_t i = 0; i < n; i++) collinear.push_back(i);
+            return;
+        }
+
+        double min_x = DBL_MAX, min_y = DBL_MAX, max_x = -DBL_MAX, max_y = -DBL_MAX;
+        for(size_t i = 0; i < n; i++)
+        {
+            min_x = std::min(min_x, xs[i]); max_x = std::max(max_x, xs[i]);
+            min_y = std::min(min_y, ys[i]); max_y = std::max(max_y, ys[i]);
+        }
+        double bx = (min_x + max_x) / 2, by = (min_y + max_y) / 2;
+
+        // Seed triangle: point closest to the centre, its nearest point, and the point making the smallest circumcircle
+        int i0 = 0, i1 = -1, i2 = -1;
+        double min_dist = DBL_MAX;
+        for(size_t i = 0; i < n; i++)
+        {
+            double d = dist2(bx, by, xs[i], ys[i]);
+            if(d < min_dist) { i0 = i; min_dist = d; }
+        }
+        min_dist = DBL_MAX;
+        for(size_t i = 0; i < n; i++)
+        {
+            if((int)i == i0) continue;
+            double d = dist2(xs[i0], ys[i0], xs[i], ys[i]);
+            if(d < min_dist && d > 0) { i1 = i; min_dist = d; }
+        }
+        double min_radius = DBL_MAX;
+        for(size_t i = 0; i < n; i++)
+        {
+            if((int)i == i0 || (int)i == i1) continue;
+            double r = circumradius(xs[i0], ys[i0], xs[i1], ys[i1], xs[i], ys[i]);
+            if(r < min_radius) { i2 = i; min_radius = r; }
+        }
+
+        // All points on one line (up to rounding noise, which the plain predicates cannot resolve):
+        // order them along it
+        bool flat = (i1 == -1 || i2 == -1);
+        if(!flat)
+        {
+            double dx = xs[i1] - xs[i0], dy = ys[i1] - ys[i0];
+            double tol = 1e-9 * std::max(max_x - min_x, max_y - min_y) * std::sqrt(dx * dx + dy * dy);
+            flat = true;
+            for(size_t i = 0; i < n && flat; i++)
+            {
+                if(std::fabs(dx * (ys[i] - ys[i0]) - dy * (xs[i] - xs[i0])) > tol) flat = false;
+            }
+        }
+        std::vector<std::pair<double, int>> by_dist(n);
+        if(flat)
+        {
+            double dx = xs[i1] - xs[i0], dy = ys[i1] - ys[i0];
+            for(size_t i = 0; i < n; i++) by_dist[i] = {dx * (xs[i] - xs[i0]) + dy * (ys[i] - ys[i0]), (int)i};
+            std::sort(by_dist.begin(), by_dist.end());
+            for(auto& p : by_dist) collinear.push_back(p.second);
+            return;
+        }
+
+        if(orient(xs[i0], ys[i0], xs[i1], ys[i1], xs[i2], ys[i2])) std::swap(i1, i2);
+        circumcenter(xs[i0], ys[i0], xs[i1], ys[i1], xs[i2], ys[i2], cx, cy);
+
+        // Points are inserted in order of distance from the seed circumcentre
+        for(size_t i = 0; i < n; i++) by_dist[i] = {dist2(xs[i], ys[i], cx, cy), (int)i};
+        std::sort(by_dist.begin(), by_dist.end());
+
+        hash_size = std::ceil(std::sqrt((double)n));
+        hull_prev.assign(n, -1);
+        hull_next.assign(n, -1);
+        hull_tri.assign(n, -1);
+        hull_hash.assign(hash_size, -1);
+
+        hull_start = i0;
+        hull_next[i0] = hull_prev[i2] = i1;
+        hull_next[i1] = hull_prev[i0] = i2;
+        hull_next[i2] = hull_prev[i1] = i0;
+        hull_tri[i0] = 0;
+        hull_tri[i1] = 1;
+        hull_tri[i2] = 2;
+        hull_hash[hash_key(xs[i0], ys[i0])] = i0;
+        hull_hash[hash_key(xs[i1], ys[i1])] = i1;
+        hull_hash[hash_key(xs[i2], ys[i2])] = i2;
+
+        size_t max_triangles = (n > 3) ? 2 * n - 5 : 1;
+        triangles.reserve(max_triangles * 3);
+        halfedges.reserve(max_triangles * 3);
+        add_triangle(i0, i1, i2, -1, -1, -1);
+
+        const double EPS = std::ldexp(1.0, -52);
+        double xp = 0, yp = 0;
+        for(size_t k = 0; k < n; k++)
+        {
+            int i = by_dist[k].second;
+            double x = xs[i], y = ys[i];
+
+            // skip near-duplicate points
+            if(k > 0 && std::fabs(x - xp) <= EPS && std::fabs(y - yp) <= EPS) continue;
+            xp = x;
+            yp = y;
+            if(i == i0 || i == i1 || i == i2) continue;
+
+            // a visible edge on the convex hull, found through the angular hash
+            int start = 0;
+            int key = hash_key(x, y);
+            for(int j = 0; j < hash_size; j++)
+            {
+                start = hull_hash[(key + j) % hash_size];
+                if(start != -1 && start != hull_next[start]) break;
+            }
+            start = hull_prev[start];
+            int e = start, q;
+            while(q = hull_next[e], !orient(x, y, xs[e], ys[e], xs[q], ys[q]))
+            {
+                e = q;
+                if(e == start)
+                {
+                    e = -1;
+                    break;
+                }
+            }
+            if(e == -1) continue; // numerically a duplicate, left out
+
+            // first triangle from the point
+            int t = add_triangle(e, i, hull_next[e], -1, -1, hull_tri[e]);
+            hull_tri[i] = legalize(t + 2);
+            hull_tri[e] = t;
+
+            // walk forward along the hull, adding more triangles
+            int nx = hull_next[e];
+            while(q = hull_next[nx], orient(x, y, xs[nx], ys[nx], xs[q], ys[q]))
+            {
+                t = add_triangle(nx, i, q, hull_tri[i], -1, hull_tri[nx]);
+                hull_tri[i] = legalize(t + 2);
+                hull_next[nx] = nx; // removed from the hull
+                nx = q;
+            }
+
+            // walk backward from the other side
+            if(e == start)
+            {
+                while(q = hull_prev[e], orient(x, y, xs[q], ys[q], xs[e], ys[e]))
+                {
+                    t = add_triangle(q, i, e, -1, hull_tri[e], hull_tri[q]);
+                    legalize(t + 2);
+                    hull_tri[q] = t;
+                    hull_next[e] = e;
+                    e = q;
+                }
+            }
+
+            hull_start = hull_prev[i] = e;
+            hull_next[e] = hull_prev[nx] = i;
+            hull_next[i] = nx;
+
+            hull_hash[hash_key(x, y)] = i;
+            hull_hash[hash_key(xs[e], ys[e])] = e;
+        }
+    }
+
+public:
+    DelaunayTriangulation(size_t _n, const double* _xs, const double* _ys)
+        : n(_n), xs(_xs), ys(_ys)
+    {
+        triangulate();
+    }
+
+    // Every undirected edge of the triangulation once, as point id pairs
+    void edges(std::vector<std::pair<int, int>>& out) const
+    {
+        out.clear();
+        if(triangles.empty())
+        {
+            for(size_t k = 1; k < collinear.size(); k++) out.push_back({collinear[k - 1], collinear[k]});
+            return;
+        }
+        out.reserve(triangles.size() / 2 + n);
+        for(size_t e = 0; e < triangles.size(); e++)
+        {
+            if(halfedges[e] < (int)e)
+            {
+                size_t next = (e % 3 == 2) ? e - 2 : e + 1;
+                out.push_back({triangles[e], triangles[next]});
+            }
+        }
+    }
+};
+
+// n - 1 edges of a Euclidean minimum spanning tree of the points, as point id pairs
+inline void euclidean_mst(size_t n, const double* xs, const double* ys, std::vector<std::pair<int, int>>& mst)
+{
+    mst.clear();
+    if(n < 2) return;
+    mst.reserve(n - 1);
+
+    // Duplicates are merged before triangulating, each copy hangs off the first with a zero length edge
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [xs, ys](int a, int b) {
+        if(xs[a] != xs[b]) return xs[a] < xs[b];
+        if(ys[a] != ys[b]) return ys[a] < ys[b];
+        return a < b;
+    });
+    std::vector<int> uid;
+    std::vector<double> ux, uy;
+    for(size_t k = 0; k < n; k++)
+    {
+        int i = order[k];
+        if(k > 0 && xs[i] == ux.back() && ys[i] == uy.back())
+        {
+            mst.push_back({uid.back(), i});
+            continue;
+        }
+        uid.push_back(i);
+        ux.push_back(xs[i]);
+        uy.push_back(ys[i]);
+    }
+    const size_t m = uid.size();
+    if(m < 2) return;
+
+    // Kruskal on the Delaunay edges
+    std::vector<std::pair<int, int>> dt;
+    DelaunayTriangulation(m, ux.data(), uy.data()).edges(dt);
+    std::vector<std::pair<double, std::pair<int, int>>> cand;
+    cand.reserve(dt.size());
+    for(auto& e : dt)
+    {
+        int a = std::min(e.first, e.second), b = std::max(e.first, e.second);
+        cand.push_back({(ux[a] - ux[b]) * (ux[a] - ux[b]) + (uy[a] - uy[b]) * (uy[a] - uy[b]), {a, b}});
+    }
+    std::sort(cand.begin(), cand.end());
+
+    DisjointSet ds(m);
+    size_t components = m;
+    for(auto& c : cand)
+    {
+        if(ds.unite(c.second.first, c.second.second))
+        {
+            mst.push_back({uid[c.second.first], uid[c.second.second]});
+            if(--components == 1) break;
+        }
+    }
+
+    // Points the triangulation had to leave out (numerically degenerate input) join their nearest neighbour
+    if(components > 1)
+    {
+        KDTree kd(m, ux.data(), uy.data());
+        while(components > 1)
+        {
+            for(size_t u = 0; u < m && components > 1; u++)
+            {
+                int cu = ds.find(u);
+                if(cu == ds.find(0)) continue;
+                int v = kd.nearest_if(ux[u], uy[u], [&ds, cu](int id) { return ds.find(id) != cu; });
+                if(v >= 0 && ds.unite(u, v))
+                {
+                    mst.push_back({uid[u], uid[v]});
+                    components--;
+                }
+            }
+        }
+    }
+}
+
+// Boruvka, shared by both boruvka_mst() flavours.
+// begin_round(comp) runs before every round with the current component of every node, then
+// best(u, comp, &d) gives the nearest node to u outside u's component comp[u] (-1 if none), it is
+// called in parallel. Edges are compared on (length, smaller id, larger id), a strict order, so
+// no cycles can form on ties. Stops at a spanning forest when no component has an outgoing edge.
+template <typename BeginRound, typename Best>
+void boruvka_rounds(size_t n, int nthreads, BeginRound begin_round, Best best, std::vector<std::pair<int, int>>& mst)
+{
+    mst.clear();
+    if(n < 2) return;
+#ifdef _OPENMP
+    if(nthreads <= 0) nthreads = omp_get_max_threads();
+#endif
+    if(nthreads <= 0) nthreads = 1;
+
+    DisjointSet ds(n);
+    std::vector<int> comp(n);
+    std::iota(comp.begin(), comp.end(), 0);
+    std::vector<int> to(n);
+    std::vector<double> d(n);
+    std::vector<int> comp_best(n); // node holding the best outgoing edge, per component root
+    size_t components = n;
+
+    auto less = [&](int a, int b) { // edge (a, to[a]) before edge (b, to[b])
+        if(d[a] != d[b]) return d[a] < d[b];
+        int a1 = std::min(a, to[a]), b1 = std::min(b, to[b]);
+        if(a1 != b1) return a1 < b1;
+        return std::max(a, to[a]) < std::max(b, to[b]);
+    };
+
+    while(components > 1)
+    {
+        begin_round(comp);
+        #pragma omp parallel for schedule(dynamic, 64) num_threads(nthreads)
+        for(long u = 0; u < (long)n; u++)
+        {
+            to[u] = best(u, comp, &d[u]);
+        }
+
+        std::fill(comp_best.begin(), comp_best.end(), -1);
+        for(size_t u = 0; u < n; u++)
+        {
+            if(to[u] < 0) continue;
+            int& cb = comp_best[comp[u]];
+            if(cb < 0 || less(u, cb)) cb = u;
+        }
+
+        size_t before = components;
+        for(size_t c = 0; c < n; c++)
+        {
+            int u = comp_best[c];
+            if(u >= 0 && ds.unite(u, to[u]))
+            {
+                mst.push_back({u, to[u]});
+                components--;
+            }
+        }
+        if(components == before) break; // disconnected candidate graph
+
+        for(size_t u = 0; u < n; u++) comp[u] = ds.find(u);
+    }
+}
+
+// Parallel Boruvka over the implicit complete Euclidean graph of the points.
+// nthreads <= 0 means the OpenMP default.
+inline void boruvka_mst(size_t n, const double* xs, const double* ys, int nthreads, std::vector<std::pair<int, int>>& mst)
+{
+    KDTree kd(n, xs, ys);
+    std::vector<int> node_label; // component of a whole k-d subtree, -1 if mixed
+
+    auto begin_round = [&](const std::vector<int>& comp) { kd.node_labels(comp, node_label); };
+    auto best = [&](int u, const std::vector<int>& comp, double* d) {
+        int c = comp[u];
+        return kd.nearest_if(xs[u], ys[u],
+                             [&comp, c](int id) { return comp[id] != c; },
+                             [&node_label, c](int ni) { return node_label[ni] != c; }, d);
+    };
+    boruvka_rounds(n, nthreads, begin_round, best, mst);
+}
+
+// Parallel Boruvka over a sparse candidate graph (e.g. kNN): adj[u] lists edges with
+// .to and .length. If the graph is disconnected the result is a spanning forest.
+template <typename Graph>
+void boruvka_mst(const Graph& adj, int nthreads, std::vector<std::pair<int, int>>& mst)
+{
+    auto begin_round = [](const std::vector<int>&) {};
+    auto best = [&adj](int u, const std::vector<int>& comp, double* d) {
+        int best_v = -1;
+        double best_d = DBL_MAX;
+        for(const auto& e : adj[u])
+        {
+            int v = e.to;
+            if(comp[v] == comp[u]) continue;
+            if(e.length < best_d || (e.length == best_d && v < best_v))
+            {
+                best_d = e.length;
+                best_v = v;
+            }
+        }
+        *d = best_d;
+        return best_v;
+    };
+    boruvka_rounds(adj.size(), nthreads, begin_round, best, mst);
+}
+
+// Parent of every node in the tree rooted at root (-1 for the root and for nodes not reached).
+// Lets callers list the tree edges node by node, the way the Prim's implementations do.
+inline void tree_parents(size_t n, const std::vector<std::pair<int, int>>& edges, int root, std::vector<int>& parent)
+{
+    std::vector<int> start(n + 1, 0), adj(2 * edges.size());
+    for(auto& e : edges)
+    {
+        start[e.first + 1]++;
+        start[e.second + 1]++;
+    }
+    for(size_t i = 0; i < n; i++) start[i + 1] += start[i];
+    std::vector<int> fill(start.begin(), start.end() - 1);
+    for(auto& e : edges)
+    {
+        adj[fill[e.first]++] = e.second;
+        adj[fill[e.second]++] = e.first;
+    }
+
+    parent.assign(n, -1);
+    std::vector<char> seen(n, 0);
+    std::vector<int> queue;
+    queue.reserve(n);
+    queue.push_back(root);
+    seen[root] = 1;
+    for(size_t h = 0; h < queue.size(); h++)
+    {
+        int u = queue[h];
+        for(int k = start[u]; k < start[u + 1]; k++)
+        {
+            int v = adj[k];
+            if(seen[v]) continue;
+            seen[v] = 1;
+            parent[v] = u;
+            queue.push_back(v);
+        }
+    }
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "vrp-single-threaded.h"
+#include "spatial-index.h"
+#include "route-search.h"
+#include "held-karp.h"
 
 void tsp_approx(const CVRP &vrp, std::vector<node_t> &cities, std::vector<node_t> &tour, node_t ncities) {
   node_t i, j;
@@ -13,6 +16,12 @@ void tsp_approx(const CVRP &vrp, std::vector<node_t> &cities, std::vector<node_t
 
   tour[0] = cities[ncities - 1];
 
+  if (ncities >= NN_TOUR_MIN_KD) {  // long route: nearest unvisited point from the k-d tree
+    nearest_neighbour_reorder(tour.data(), ncities, [&vrp](node_t v) { return vrp.node[v].x; },
+                              [&vrp](node_t v) { return vrp.node[v].y; });
+    return;
+  }
+
   for (i = 1; i < ncities; i++) {
     //~ double ThisX = points.x_coords[tour[i-1]];
     //~ double ThisY = points.y_coords[tour[i-1]];
@@ -70,60 +79,10 @@ postprocess_tsp_approx(const CVRP &vrp, const std::vector<std::vector<node_t>> &
   return modifiedRoutes;
 }
 
-void tsp_2opt(const CVRP &vrp, std::vector<node_t> &cities, std::vector<node_t> &tour, unsigned ncities) {
-  // 'cities' contains the original solution. It is updated during the course of the 2opt-scheme to contain the 2opt soln.
-  // 'tour' is an auxillary array.
-
-  // repeat until no improvement is made
-  unsigned improve = 0;
-
-  while (improve < 2) {
-    double best_distance = 0.0;
-
-    best_distance += vrp.get_distance_on_the_fly(vrp.depot, cities[0]);  // computing distance of the first point in the route with the depot.
-
-    for (unsigned jj = 1; jj < ncities; ++jj) {
-      best_distance += vrp.get_distance_on_the_fly(cities[jj - 1], cities[jj]);
-    }
-
-    best_distance += vrp.get_distance_on_the_fly(vrp.depot, cities[ncities - 1]);
-    // 1x 2x 3x 4 5
-    //  1 2  3  4 5
-    for (unsigned i = 0; i < ncities - 1; i++) {
-      for (unsigned k = i + 1; k < ncities; k++) {
-        for (unsigned c = 0; c < i; ++c) {
-          tour[c] = cities[c];
-        }
-
-        unsigned dec = 0;
-        for (unsigned c = i; c < k + 1; ++c) {
-          tour[c] = cities[k - dec];
-          dec++;
-        }
-
-        for (unsigned c = k + 1; c < ncities; ++c) {
-          tour[c] = cities[c];
-        }
-        double new_distance = 0.0;
-
-        new_distance += vrp.get_distance_on_the_fly(vrp.depot, tour[0]);
-        for (unsigned jj = 1; jj < ncities; ++jj) {
-          new_distance += vrp.get_distance_on_the_fly(tour[jj - 1], tour[jj]);
-        }
-
-        new_distance += vrp.get_distance_on_the_fly(vrp.depot, tour[ncities - 1]);
-
-        if (new_distance < best_distance) {
-          // Improvement found so reset
-          improve = 0;
-          for (unsigned jj = 0; jj < ncities; jj++)
-            cities[jj] = tour[jj];
-          best_distance = new_distance;
-        }
-      }
-    }
-    improve++;
-  }
+void tsp_2opt(const CVRP &vrp, std::vector<node_t> &cities, unsigned ncities) {
+  // 'cities' contains the original solution. It is updated in place to contain the 2opt soln.
+  optimise_route(cities.data(), ncities, (node_t)vrp.depot, [&vrp](node_t a, node_t b) { return vrp.get_distance_on_the_fly(a, b); },
+                 [&vrp](node_t v) { return vrp.node[v].x; }, [&vrp](node_t v) { return vrp.node[v].y; });
 }
 
 std::vector<std::vector<node_t>>
@@ -136,7 +95,6 @@ postprocess_2OPT(const CVRP &vrp, const std::vector<std::vector<node_t>> &final_
     unsigned sz = final_routes[i].size();
 
     std::vector<node_t> cities(sz);
-    std::vector<node_t> tour(sz);
 
     for (unsigned j = 0; j < sz; ++j)
       cities[j] = final_routes[i][j];
@@ -144,7 +102,7 @@ postprocess_2OPT(const CVRP &vrp, const std::vector<std::vector<node_t>> &final_
     std::vector<node_t> curr_route;
 
     if (sz > 2)                         // for sz <= 1, the cost of the path cannot change. So no point running this.
-      tsp_2opt(vrp, cities, tour, sz);  //MAIN
+      tsp_2opt(vrp, cities, sz);  //MAIN
 
     for (unsigned kk = 0; kk < sz; ++kk) {
       curr_route.push_back(cities[kk]);
@@ -0,0 +1,195 @@
+#pragma once
+
+/*
+Randomized depth-first traversal of a (spanning) tree without per-iteration allocations.
+The adjacency is packed once into CSR arrays; shuffle() permutes every neighbour slice in
+place and visit()/tour() walk the tree with an explicit stack, so each call costs O(n) and
+never touches the heap. Visited flags are epoch stamps, cleared only when the epoch wraps.
+
+One object per thread: copies are independent, the traversal state is all member data.
+
+shuffled_walk() starts every neighbour list from the order given to build(), so its tour
+depends on nothing but the RNG. With a SplitMix64 seeded from (seed, iteration) any
+iteration can be replayed later, and only the seed of the best one needs to be kept.
+*/
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// Counter-based 64-bit generator (Steele et al.); constructing one is as cheap as a copy.
+class SplitMix64
+{
+    uint64_t state;
+
+public:
+    using result_type = uint64_t;
+
+    explicit SplitMix64(uint64_t seed) : state(seed) {}
+
+    // Stream for iteration `counter` of the run seeded with `seed`
+    SplitMix64(uint64_t seed, uint64_t counter) : state(seed)
+    {
+        state = (*this)() ^ counter;
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+};
+
+class RandomDFS
+{
+    std::vector<int> offset;        // neighbours of u are adj[offset[u] .. offset[u + 1])
+    std::vector<int> adj;
+    std::vector<int> adj0;          // the order given to build()
+    std::vector<unsigned> mark;     // mark[u] == epoch <=> u visited in the current traversal
+    unsigned epoch = 0;
+    std::vector<int> stack_node;    // explicit DFS stack: vertex and next neighbour slot
+    std::vector<int> stack_pos;
+    std::vector<int> order;         // output buffer of tour()
+
+public:
+    RandomDFS() {}
+
+    // g[u] lists the neighbours of u, target(e) gives the vertex of list entry e
+    template <class Graph, class Target>
+    RandomDFS(const Graph& g, Target target)
+    {
+        build(g, target);
+    }
+
+    template <class Graph>
+    explicit RandomDFS(const Graph& g)
+    {
+        build(g, [](int v) { return v; });
+    }
+
+    template <class Graph, class Target>
+    void build(const Graph& g, Target target)
+    {
+        const size_t n = g.size();
+        offset.assign(n + 1, 0);
+        for(size_t u = 0; u < n; u++)
+            offset[u + 1] = offset[u] + (int)g[u].size();
+
+        adj.resize(offset[n]);
+        for(size_t u = 0; u < n; u++)
+        {
+            int k = offset[u];
+            for(const auto& e : g[u])
+                adj[k++] = target(e);
+        }
+        adj0 = adj;
+
+        mark.assign(n, 0);
+        epoch = 0;
+        stack_node.resize(n);
+        stack_pos.resize(n);
+        order.reserve(n);
+    }
+
+    size_t size() const
+    {
+        return mark.size();
+    }
+
+    // Fresh random order of every neighbour list, in vertex order
+    template <class RNG>
+    void shuffle(RNG& rng)
+    {
+        const size_t n = size();
+        for(size_t u = 0; u < n; u++)
+            std::shuffle(adj.begin() + offset[u], adj.begin() + offset[u + 1], rng);
+    }
+
+    // Calls f(u) for every vertex reachable from root, in preorder; same order as the
+    // recursive DFS that follows the neighbour lists front to back.
+    template <class Visit>
+    void visit(int root, Visit&& f)
+    {
+        walk(root, [&f](int u) { f(u); return true; });
+    }
+
+    // As visit(), but stops as soon as f(u) returns false. True if the walk was completed.
+    template <class Visit>
+    bool walk(int root, Visit&& f)
+    {
+        return walk_expand(root, f, [](int) {});
+    }
+
+    // As walk(), with each neighbour list reset to the build() order and shuffled just
+    // before its vertex is expanded: the same distribution as shuffle() + walk(), but a walk
+    // cut short pays only for its prefix. A completed walk leaves every list shuffled, so
+    // tour() replays it.
+    template <class RNG, class Visit>
+    bool shuffled_walk(int root, RNG& rng, Visit&& f)
+    {
+        return walk_expand(root, f, [this, &rng](int u) {
+            std::copy(adj0.begin() + offset[u], adj0.begin() + offset[u + 1], adj.begin() + offset[u]);
+            std::shuffle(adj.begin() + offset[u], adj.begin() + offset[u + 1], rng);
+        });
+    }
+
+private:
+    template <class Visit, class Expand>
+    bool walk_expand(int root, Visit& f, Expand expand)
+    {
+        if(++epoch == 0)
+        {
+            std::fill(mark.begin(), mark.end(), 0);
+            epoch = 1;
+        }
+
+        int top = 0;
+        mark[root] = epoch;
+        if(!f(root))
+            return false;
+        expand(root);
+        stack_node[0] = root;
+        stack_pos[0] = offset[root];
+
+        while(top >= 0)
+        {
+            const int u = stack_node[top];
+            const int end = offset[u + 1];
+            int k = stack_pos[top];
+            while(k < end && mark[adj[k]] == epoch)
+                k++;
+
+            if(k == end)
+            {
+                top--;
+                continue;
+            }
+
+            const int v = adj[k];
+            stack_pos[top] = k + 1;
+            mark[v] = epoch;
+            if(!f(v))
+                return false;
+            expand(v);
+            top++;
+            stack_node[top] = v;
+            stack_pos[top] = offset[v];
+        }
+        return true;
+    }
+
+public:
+    // Preorder from root; the buffer is reused by the next call
+    const std::vector<int>& tour(int root)
+    {
+        order.clear();
+        visit(root, [this](int u) { order.push_back(u); });
+        return order;
+    }
+};
@@ -0,0 +1,353 @@
+#pragma once
+
+/*
+Intra-route local search: 2-opt and Or-opt restricted to candidate neighbour lists,
+driven by don't-look bits (Bentley 1992; Johnson & McGeoch 1997).
+
+The route is handled as a cycle through the depot. Every node keeps its K nearest
+route-mates (k-d tree), and a move is only tried if it creates an edge to one of them.
+Nodes whose neighbourhood held no improving move are dropped from the work queue until a
+move touches one of their edges, so after the first sweep the search only revisits the
+few places that changed. Positions are stored per node, so a move is priced in O(1);
+applying it moves the shorter side of the cycle.
+
+Or-opt moves a segment of 1..OR_OPT_MAX_LEN consecutive nodes, in either orientation,
+next to a candidate neighbour of one of its ends. Distances are assumed symmetric.
+
+First-improvement (the default) applies the first improving move found around a node;
+best-improvement prices every candidate move around it and applies the largest gain.
+*/
+
+#include "spatial-index.h"
+#include "held-karp.h"
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+
+// Gains below this are float noise, not improvements (and could cycle)
+constexpr double TWO_OPT_EPS = 1e-9;
+
+// Shorter routes go to held_karp() instead (see optimise_route below): their candidate
+// lists would hold the whole route
+constexpr size_t ROUTE_SEARCH_MIN_LEN = 8;
+
+class RouteSearch
+{
+    static constexpr int OR_OPT_MAX_LEN = 3;
+    static constexpr int CANDIDATES_MIN_KD = 64;   // shorter cycles get their candidate lists by a full scan
+
+    int m = 0;                      // nodes on the cycle, depot included (local id 0)
+    int K = 0;
+    std::vector<long> id;           // id[u]: caller's id of local node u
+    std::vector<int> tour;          // tour[p]: local id at position p
+    std::vector<int> pos;           // pos[tour[p]] == p
+    std::vector<int> nbr;           // nbr[u * K .. u * K + K): nearest route-mates of u
+    std::vector<double> xs, ys;
+    std::vector<int> queue;         // circular FIFO of nodes whose don't-look bit is off
+    std::vector<char> queued;
+    size_t head = 0, count = 0;
+    std::vector<std::pair<double, int>> found;
+    KDTree tree;
+
+    // An improving move around the node being scanned
+    struct Move
+    {
+        double gain;
+        int s, e;               // 2-opt: reverse the path s..e; Or-opt: the segment s..e
+        int len;                // Or-opt: nodes in the segment, 0 for 2-opt
+        int u, w;               // Or-opt: the segment goes between u and w = next(u)
+        bool reversed;
+        int touched[6];         // nodes whose don't-look bits are cleared, in order
+        int num_touched;
+    };
+
+    int next(int u) const { return tour[pos[u] + 1 == m ? 0 : pos[u] + 1]; }
+    int prev(int u) const { return tour[pos[u] == 0 ? m - 1 : pos[u] - 1]; }
+    int at(int p) const { return tour[p >= m ? p - m : (p < 0 ? p + m : p)]; }
+
+    // Steps forward from u to v along the cycle
+    int ahead(int u, int v) const
+    {
+        const int d = pos[v] - pos[u];
+        return d < 0 ? d + m : d;
+    }
+
+    void push(int u)
+    {
+        if(queued[u])
+            return;
+        queued[u] = 1;
+        queue[(head + count++) % m] = u;
+    }
+
+    void place(int p, int u)
+    {
+        if(p >= m) p -= m;
+        tour[p] = u;
+        pos[u] = p;
+    }
+
+    // Reverses the path from u forward to v; the complement is reversed instead if it is
+    // shorter, which gives the same cycle.
+    void reverse(int u, int v)
+    {
+        int len = ahead(u, v) + 1;
+        if(2 * len > m)
+        {
+            const int w = next(v);
+            v = prev(u);
+            u = w;
+            len = m - len;
+        }
+        for(int i = pos[u], j = pos[v], s = 0; 2 * s + 1 < len; s++)
+        {
+            const int a = tour[i], b = tour[j];
+            place(i, b);
+            place(j, a);
+            i = (i + 1 == m ? 0 : i + 1);
+            j = (j == 0 ? m - 1 : j - 1);
+        }
+    }
+
+    // Moves the segment s..e (forward, len nodes) between the neighbours u and w = next(u)
+    void move_segment(int s, int e, int len, int u, int w, bool reversed)
+    {
+        int seg[OR_OPT_MAX_LEN];
+        for(int i = 0, x = (reversed ? e : s); i < len; i++, x = (reversed ? prev(x) : next(x)))
+            seg[i] = x;
+
+        const int fwd = ahead(e, u), bwd = ahead(w, s);
+        int first;
+        if(fwd <= bwd)
+        {
+            // e+1 .. u slide back by len, the segment follows u
+            first = pos[s];
+            for(int i = 0; i < fwd; i++)
+                place(first + i, at(first + len + i));
+            first += fwd;
+        }
+        else
+        {
+            // w .. s-1 slide forward by len, the segment precedes w
+            first = pos[w];
+            for(int i = bwd - 1; i >= 0; i--)
+                place(first + len + i, at(first + i));
+        }
+        for(int i = 0; i < len; i++)
+            place(first + i, seg[i]);
+    }
+
+    // Records in mv the improving moves around a that beat mv.gain; stops at the first
+    // one unless best. Returns true if mv was updated.
+    template <class D>
+    bool try_2opt(int a, D& d, Move& mv, bool best)
+    {
+        bool found_move = false;
+        const int b = next(a), p = prev(a);
+        const double dab = d(a, b), dpa = d(p, a);
+        for(int t = 0; t < K; t++)
+        {
+            const int c = nbr[a * K + t];
+            const double dac = d(a, c);
+            if(dac >= dab && dac >= dpa)    // lists are sorted: no later candidate can gain
+                break;
+
+            // (a, b) + (c, next c)  ->  (a, c) + (b, next c)
+            const int cn = next(c);
+            if(dac < dab && c != b && cn != a)
+            {
+                const double gain = dab + d(c, cn) - dac - d(b, cn);
+                if(gain > mv.gain)
+                {
+                    mv = Move{gain, b, c, 0, -1, -1, false, {a, b, c, cn}, 4};
+                    found_move = true;
+                    if(!best)
+                        return true;
+                }
+            }
+
+            // (prev a, a) + (prev c, c)  ->  (a, c) + (prev a, prev c)
+            const int cp = prev(c);
+            if(dac < dpa && c != p && cp != a)
+            {
+                const double gain = dpa + d(cp, c) - dac - d(p, cp);
+                if(gain > mv.gain)
+                {
+                    mv = Move{gain, a, cp, 0, -1, -1, false, {a, p, c, cp}, 4};
+                    found_move = true;
+                    if(!best)
+                        return true;
+                }
+            }
+        }
+        return found_move;
+    }
+
+    // As try_2opt, for the segments starting at s
+    template <class D>
+    bool try_or_opt(int s, D& d, Move& mv, bool best)
+    {
+        bool found_move = false;
+        int e = s;
+        for(int len = 1; len <= OR_OPT_MAX_LEN && len + 3 <= m; len++, e = next(e))
+        {
+            const int p = prev(s), n = next(e);
+            const double removed = d(p, s) + d(e, n) - d(p, n);
+            if(removed <= TWO_OPT_EPS)
+                continue;
+
+            // Inserting between u and w = next(u): the segment must avoid that edge
+            auto outside = [&](int x) { return ahead(s, x) >= len; };
+
+            for(int end = 0; end < (len == 1 ? 1 : 2); end++)
+            {
+                const int x = (end == 0 ? s : e), y = (end == 0 ? e : s);
+                for(int t = 0; t < K; t++)
+                {
+                    const int c = nbr[x * K + t];
+                    const double dxc = d(x, c);
+                    if(dxc >= removed)
+                        break;
+
+                    // x next to c on either side; orientation follows from which side
+                    for(int side = 0; side < 2; side++)
+                    {
+                        const int u = (side == 0 ? c : prev(c)), w = (side == 0 ? next(c) : c);
+                        if(!outside(u) || !outside(w))
+                            continue;
+                        const int far = (side == 0 ? w : u);
+                        const double gain = removed - dxc - d(y, far) + d(u, w);
+                        if(gain > mv.gain)
+                        {
+                            // side 0: u-x..y-w, side 1: u-y..x-w; s first means not reversed
+                            const bool reversed = (side == 0) != (x == s);
+                            mv = Move{gain, s, e, len, u, w, reversed, {p, n, s, e, u, w}, 6};
+                            found_move = true;
+                            if(!best)
+                                return true;
+                        }
+                    }
+                }
+            }
+        }
+        return found_move;
+    }
+
+    void apply(const Move& mv)
+    {
+        if(mv.len == 0)
+            reverse(mv.s, mv.e);
+        else
+            move_segment(mv.s, mv.e, mv.len, mv.u, mv.w, mv.reversed);
+        for(int i = 0; i < mv.num_touched; i++)
+            push(mv.touched[i]);
+    }
+
+public:
+    // Improves the closed route depot, route[0..n), depot in place. dist(a, b), x(v) and y(v)
+    // take the ids stored in the route; k is the length of the candidate lists, best selects
+    // best-improvement. Buffers are reused across calls, coordinates are only read for routes
+    // long enough for the k-d tree. Returns the total change in length (<= 0).
+    template <class Node, class Dist, class X, class Y>
+    double run(Node* route, size_t n, Node depot, Dist dist, X x, Y y, int k = 8, bool best = false)
+    {
+        double total = 0.0;
+        if(n < 3)
+            return total;
+
+        m = (int)n + 1;
+        K = std::min(k, m - 1);
+        id.resize(m);
+        id[0] = (long)depot;
+        for(int u = 1; u < m; u++)
+            id[u] = (long)route[u - 1];
+        auto d = [&](int a, int b) { return (double)dist((Node)id[a], (Node)id[b]); };
+
+        tour.resize(m);
+        pos.resize(m);
+        for(int u = 0; u < m; u++)
+        {
+            tour[u] = u;
+            pos[u] = u;
+        }
+
+        // Candidate lists, sorted by dist() itself in case it is rounded
+        nbr.resize((size_t)m * K);
+        if(m < CANDIDATES_MIN_KD)
+        {
+            found.resize(m - 1);
+            for(int u = 0; u < m; u++)
+            {
+                for(int v = 0, j = 0; v < m; v++)
+                    if(v != u)
+                        found[j++] = std::make_pair(d(u, v), v);
+                std::partial_sort(found.begin(), found.begin() + K, found.end());
+                for(int t = 0; t < K; t++)
+                    nbr[u * K + t] = found[t].second;
+            }
+        }
+        else
+        {
+            xs.resize(m);
+            ys.resize(m);
+            for(int u = 0; u < m; u++)
+            {
+                xs[u] = x((Node)id[u]);
+                ys[u] = y((Node)id[u]);
+            }
+            tree.build(m, xs.data(), ys.data());
+            for(int u = 0; u < m; u++)
+            {
+                tree.knn(xs[u], ys[u], K, found, u);
+                for(int t = 0; t < K; t++)
+                    nbr[u * K + t] = found[t].second;
+                std::sort(nbr.begin() + u * K, nbr.begin() + (u + 1) * K,
+                          [&](int a, int b) { return d(u, a) < d(u, b); });
+            }
+        }
+
+        queue.resize(m);
+        queued.assign(m, 0);
+        head = count = 0;
+        for(int u = 0; u < m; u++)
+            push(u);
+
+        while(count > 0)
+        {
+            const int u = queue[head];
+            head = (head + 1) % m;
+            count--;
+            queued[u] = 0;
+
+            Move mv{};
+            mv.gain = TWO_OPT_EPS;
+            bool improved = try_2opt(u, d, mv, best);
+            if(!improved || best)
+                improved |= try_or_opt(u, d, mv, best);
+            if(improved)
+            {
+                apply(mv);
+                total -= mv.gain;
+            }
+        }
+
+        const int start = pos[0];
+        for(size_t i = 0; i < n; i++)
+            route[i] = (Node)id[at(start + 1 + (int)i)];
+        return total;
+    }
+};
+
+// Reorders the closed route depot, route[0..n), depot in place: exactly by held_karp() up to
+// HELD_KARP_MAX_LEN customers, by a RouteSearch (one per thread, so its buffers are reused) above,
+// best-improvement if best. Returns the change in length (<= 0).
+template <class Node, class Dist, class X, class Y>
+double optimise_route(Node* route, size_t n, Node depot, Dist dist, X x, Y y, bool best = false)
+{
+    static_assert(HELD_KARP_MAX_LEN + 1 >= ROUTE_SEARCH_MIN_LEN, "routes too short for RouteSearch must fit held_karp");
+    if(n <= HELD_KARP_MAX_LEN)
+        return held_karp(route, n, depot, dist);
+    static thread_local RouteSearch search;
+    return search.run(route, n, depot, dist, x, y, 8, best);
+}
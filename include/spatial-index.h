@@ -0,0 +1,438 @@
+#pragma once
+
+/*
+Static 2-d tree over the points of an instance. Built once, queried many times.
+Point ids are the indices into the coordinate arrays the tree was built from.
+All distances handed back by the queries are SQUARED euclidean distances.
+
+Queries:
+  knn / knn_if        k nearest points (optionally filtered by a predicate on the id)
+  nearest / nearest_if
+  radius / radius_if  all points within distance r
+  sector_knn_if       k nearest points whose direction from an apex lies in a cone
+  sector_if           all points in a cone
+Points can be erase()d (e.g. once visited by a nearest neighbour tour) and
+restore()d; erased points are skipped by every query.
+*/
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cfloat>
+#include <cstddef>
+
+class KDTree
+{
+    static constexpr int LEAF_SIZE = 8;
+
+    struct KDNode
+    {
+        int lo, hi;             // range [lo, hi) in px/py/pid
+        int left, right;        // children, -1 for a leaf
+        double min_x, max_x, min_y, max_y;
+    };
+
+    std::vector<double> px, py; // coordinates stored in tree order (cache friendly leaves)
+    std::vector<int> pid;       // original id of px[i], py[i]
+    std::vector<int> where;     // tree position of an original id
+    std::vector<char> alive;    // per tree position
+    std::vector<int> num_alive; // per KDNode
+    std::vector<KDNode> nodes;
+
+    int build(int lo, int hi, const double* xs, const double* ys)
+    {
+        KDNode nd;
+        nd.lo = lo; nd.hi = hi; nd.left = nd.right = -1;
+        nd.min_x = nd.min_y = DBL_MAX;
+        nd.max_x = nd.max_y = -DBL_MAX;
+        for(int i = lo; i < hi; i++)
+        {
+            nd.min_x = std::min(nd.min_x, xs[pid[i]]); nd.max_x = std::max(nd.max_x, xs[pid[i]]);
+            nd.min_y = std::min(nd.min_y, ys[pid[i]]); nd.max_y = std::max(nd.max_y, ys[pid[i]]);
+        }
+        int index = nodes.size();
+        nodes.push_back(nd);
+        if(hi - lo <= LEAF_SIZE) return index;
+
+        // Split on the wider side at the median
+        const double* key = ((nd.max_x - nd.min_x) >= (nd.max_y - nd.min_y)) ? xs : ys;
+        int mid = (lo + hi) / 2;
+        std::nth_element(pid.begin() + lo, pid.begin() + mid, pid.begin() + hi, [key](int a, int b) {
+            return key[a] < key[b];
+        });
+
+        int left  = build(lo, mid, xs, ys);
+        int right = build(mid, hi, xs, ys);
+        nodes[index].left  = left;
+        nodes[index].right = right;
+        return index;
+    }
+
+    // Squared distance from (x, y) to the bounding box of a node (0 if inside)
+    static double box_dist2(const KDNode& nd, double x, double y)
+    {
+        double dx = (x < nd.min_x) ? nd.min_x - x : (x > nd.max_x ? x - nd.max_x : 0.0);
+        double dy = (y < nd.min_y) ? nd.min_y - y : (y > nd.max_y ? y - nd.max_y : 0.0);
+        return dx * dx + dy * dy;
+    }
+
+    // Cone with apex (ax, ay), sweeping counter clockwise from direction d1 to direction d2
+    struct Sector
+    {
+        double ax, ay, d1x, d1y, d2x, d2y;
+        bool reflex; // angle from d1 to d2 is more than 180 degrees
+
+        Sector(double _ax, double _ay, double _d1x, double _d1y, double _d2x, double _d2y)
+            : ax(_ax), ay(_ay), d1x(_d1x), d1y(_d1y), d2x(_d2x), d2y(_d2y)
+        {
+            reflex = (d1x * d2y - d1y * d2x) < 0;
+        }
+
+        // Boundary rays are part of the sector
+        bool contains(double x, double y) const
+        {
+            double c1 = d1x * (y - ay) - d1y * (x - ax); // d1 x p
+            double c2 = (x - ax) * d2y - (y - ay) * d2x; // p x d2
+            if(!reflex) return c1 >= 0 && c2 >= 0;
+            return !(c1 < 0 && c2 < 0);
+        }
+
+        // false only if the box certainly has no point of the sector
+        bool may_intersect(const KDNode& nd) const
+        {
+            const double cx[4] = {nd.min_x, nd.max_x, nd.min_x, nd.max_x};
+            const double cy[4] = {nd.min_y, nd.min_y, nd.max_y, nd.max_y};
+            bool all_right_of_d1 = true, all_left_of_d2 = true;
+            for(int c = 0; c < 4; c++)
+            {
+                if(d1x * (cy[c] - ay) - d1y * (cx[c] - ax) >= 0) all_right_of_d1 = false;
+                if((cx[c] - ax) * d2y - (cy[c] - ay) * d2x >= 0) all_left_of_d2 = false;
+            }
+            // a convex cone is the intersection of two half planes, a reflex one is their union
+            if(!reflex) return !(all_right_of_d1 || all_left_of_d2);
+            return !(all_right_of_d1 && all_left_of_d2);
+        }
+    };
+
+    template <typename Pred, typename BoxPred>
+    void knn_rec(int ni, double x, double y, size_t k, std::vector<std::pair<double, int>>& heap, Pred& pred, BoxPred& box_ok) const
+    {
+        const KDNode& nd = nodes[ni];
+        if(num_alive[ni] == 0) return;
+        if(heap.size() == k && box_dist2(nd, x, y) >= heap.front().first) return;
+        if(!box_ok(nd)) return;
+
+        if(nd.left < 0)
+        {
+            for(int i = nd.lo; i < nd.hi; i++)
+            {
+                if(!alive[i] || !pred(pid[i])) continue;
+                double d2 = (px[i] - x) * (px[i] - x) + (py[i] - y) * (py[i] - y);
+                if(heap.size() < k)
+                {
+                    heap.push_back({d2, pid[i]});
+                    std::push_heap(heap.begin(), heap.end());
+                }
+                else if(d2 < heap.front().first)
+                {
+                    std::pop_heap(heap.begin(), heap.end());
+                    heap.back() = {d2, pid[i]};
+                    std::push_heap(heap.begin(), heap.end());
+                }
+            }
+            return;
+        }
+        // Nearer child first, so the far one is mostly pruned
+        double dl = box_dist2(nodes[nd.left], x, y);
+        double dr = box_dist2(nodes[nd.right], x, y);
+        if(dl <= dr)
+        {
+            knn_rec(nd.left, x, y, k, heap, pred, box_ok);
+            knn_rec(nd.right, x, y, k, heap, pred, box_ok);
+        }
+        else
+        {
+            knn_rec(nd.right, x, y, k, heap, pred, box_ok);
+            knn_rec(nd.left, x, y, k, heap, pred, box_ok);
+        }
+    }
+
+    // Ties on the distance go to the smaller id, so the answer does not depend on the tree layout
+    template <typename Pred, typename NodePred>
+    void nearest_rec(int ni, double x, double y, double& best_d2, int& best_id, Pred& pred, NodePred& node_ok) const
+    {
+        const KDNode& nd = nodes[ni];
+        if(num_alive[ni] == 0) return;
+        if(box_dist2(nd, x, y) > best_d2) return;
+        if(!node_ok(ni)) return;
+
+        if(nd.left < 0)
+        {
+            for(int i = nd.lo; i < nd.hi; i++)
+            {
+                double d2 = (px[i] - x) * (px[i] - x) + (py[i] - y) * (py[i] - y);
+                if((d2 < best_d2 || (d2 == best_d2 && pid[i] < best_id)) && alive[i] && pred(pid[i]))
+                {
+                    best_d2 = d2;
+                    best_id = pid[i];
+                }
+            }
+            return;
+        }
+        double dl = box_dist2(nodes[nd.left], x, y);
+        double dr = box_dist2(nodes[nd.right], x, y);
+        if(dl <= dr)
+        {
+            nearest_rec(nd.left, x, y, best_d2, best_id, pred, node_ok);
+            nearest_rec(nd.right, x, y, best_d2, best_id, pred, node_ok);
+        }
+        else
+        {
+            nearest_rec(nd.right, x, y, best_d2, best_id, pred, node_ok);
+            nearest_rec(nd.left, x, y, best_d2, best_id, pred, node_ok);
+        }
+    }
+
+    // Collects every alive point of the subtree with in_box(node) and in_point(tree position) true
+    template <typename BoxPred, typename PointPred>
+    void collect_rec(int ni, std::vector<int>& out, BoxPred& in_box, PointPred& in_point) const
+    {
+        const KDNode& nd = nodes[ni];
+        if(num_alive[ni] == 0 || !in_box(nd)) return;
+        if(nd.left < 0)
+        {
+            for(int i = nd.lo; i < nd.hi; i++)
+            {
+                if(alive[i] && in_point(i)) out.push_back(pid[i]);
+            }
+            return;
+        }
+        collect_rec(nd.left, out, in_box, in_point);
+        collect_rec(nd.right, out, in_box, in_point);
+    }
+
+    void update_alive(int id, int delta)
+    {
+        int pos = where[id];
+        int ni = 0;
+        while(true)
+        {
+            num_alive[ni] += delta;
+            const KDNode& nd = nodes[ni];
+            if(nd.left < 0) break;
+            ni = (pos < nodes[nd.left].hi) ? nd.left : nd.right;
+        }
+    }
+
+public:
+    KDTree() {}
+    KDTree(size_t n, const double* xs, const double* ys)
+    {
+        build(n, xs, ys);
+    }
+
+    void build(size_t n, const double* xs, const double* ys)
+    {
+        pid.resize(n);
+        for(size_t i = 0; i < n; i++) pid[i] = i;
+        nodes.clear();
+        nodes.reserve(4 * (n / LEAF_SIZE + 1));
+        if(n > 0) build(0, n, xs, ys);
+
+        // Leaves are scanned linearly, so keep their coordinates contiguous
+        px.resize(n);
+        py.resize(n);
+        where.resize(n);
+        for(size_t i = 0; i < n; i++)
+        {
+            px[i] = xs[pid[i]];
+            py[i] = ys[pid[i]];
+            where[pid[i]] = i;
+        }
+        restore_all();
+    }
+
+    // For containers of points having .x and .y (CVRP::node, VRP::node)
+    template <typename PointVec>
+    void build_from(const PointVec& pts)
+    {
+        std::vector<double> xs(pts.size()), ys(pts.size());
+        for(size_t i = 0; i < pts.size(); i++)
+        {
+            xs[i] = pts[i].x;
+            ys[i] = pts[i].y;
+        }
+        build(pts.size(), xs.data(), ys.data());
+    }
+
+    size_t size() const { return pid.size(); }
+
+    void erase(int id)
+    {
+        if(!alive[where[id]]) return;
+        alive[where[id]] = 0;
+        update_alive(id, -1);
+    }
+
+    void restore(int id)
+    {
+        if(alive[where[id]]) return;
+        alive[where[id]] = 1;
+        update_alive(id, +1);
+    }
+
+    void restore_all()
+    {
+        alive.assign(pid.size(), 1);
+        num_alive.resize(nodes.size());
+        for(size_t ni = 0; ni < nodes.size(); ni++) num_alive[ni] = nodes[ni].hi - nodes[ni].lo;
+    }
+
+    // k nearest points to (x, y) among those with pred(id) == true.
+    // out is sorted by increasing squared distance: {d2, id}
+    template <typename Pred>
+    void knn_if(double x, double y, size_t k, std::vector<std::pair<double, int>>& out, Pred pred) const
+    {
+        out.clear();
+        if(k == 0 || nodes.empty()) return;
+        auto any_box = [](const KDNode&) { return true; };
+        knn_rec(0, x, y, k, out, pred, any_box);
+        std::sort_heap(out.begin(), out.end());
+    }
+
+    // k nearest points to (x, y), skipping the point `skip` (pass -1 to keep everything)
+    void knn(double x, double y, size_t k, std::vector<std::pair<double, int>>& out, int skip = -1) const
+    {
+        knn_if(x, y, k, out, [skip](int id) { return id != skip; });
+    }
+
+    // Nearest point to (x, y) with pred(id) == true, -1 if there is none
+    template <typename Pred>
+    int nearest_if(double x, double y, Pred pred, double* dist2 = nullptr) const
+    {
+        return nearest_if(x, y, pred, [](int) { return true; }, dist2);
+    }
+
+    // As above, also skipping every tree node with node_ok(node) == false (see node_labels)
+    template <typename Pred, typename NodePred>
+    int nearest_if(double x, double y, Pred pred, NodePred node_ok, double* dist2) const
+    {
+        double best_d2 = DBL_MAX;
+        int best_id = -1;
+        if(!nodes.empty()) nearest_rec(0, x, y, best_d2, best_id, pred, node_ok);
+        if(dist2) *dist2 = best_d2;
+        return best_id;
+    }
+
+    // out[node] = label[id] if every point below the tree node has that label, -1 otherwise.
+    // E.g. with component labels, a query can skip whole subtrees of its own component.
+    void node_labels(const std::vector<int>& label, std::vector<int>& out) const
+    {
+        out.resize(nodes.size());
+        // children are created after their parent, so a reverse sweep is bottom-up
+        for(int ni = (int)nodes.size() - 1; ni >= 0; ni--)
+        {
+            const KDNode& nd = nodes[ni];
+            if(nd.left < 0)
+            {
+                int l = label[pid[nd.lo]];
+                for(int i = nd.lo + 1; i < nd.hi && l != -1; i++)
+                {
+                    if(label[pid[i]] != l) l = -1;
+                }
+                out[ni] = l;
+            }
+            else out[ni] = (out[nd.left] == out[nd.right]) ? out[nd.left] : -1;
+        }
+    }
+
+    int nearest(double x, double y, double* dist2 = nullptr) const
+    {
+        return nearest_if(x, y, [](int) { return true; }, dist2);
+    }
+
+    // All points within distance r of (x, y) with pred(id) == true (in no particular order)
+    template <typename Pred>
+    void radius_if(double x, double y, double r, std::vector<int>& out, Pred pred) const
+    {
+        out.clear();
+        if(nodes.empty()) return;
+        double r2 = r * r;
+        auto in_box = [&](const KDNode& nd) { return box_dist2(nd, x, y) <= r2; };
+        auto in_point = [&](int i) {
+            return (px[i] - x) * (px[i] - x) + (py[i] - y) * (py[i] - y) <= r2 && pred(pid[i]);
+        };
+        collect_rec(0, out, in_box, in_point);
+    }
+
+    void radius(double x, double y, double r, std::vector<int>& out) const
+    {
+        radius_if(x, y, r, out, [](int) { return true; });
+    }
+
+    // All points in the cone with apex (ax, ay) swept counter clockwise from (d1x, d1y) to (d2x, d2y),
+    // with pred(id) == true (in no particular order)
+    template <typename Pred>
+    void sector_if(double ax, double ay, double d1x, double d1y, double d2x, double d2y, std::vector<int>& out, Pred pred) const
+    {
+        out.clear();
+        if(nodes.empty()) return;
+        Sector sec(ax, ay, d1x, d1y, d2x, d2y);
+        auto in_box = [&](const KDNode& nd) { return sec.may_intersect(nd); };
+        auto in_point = [&](int i) { return sec.contains(px[i], py[i]) && pred(pid[i]); };
+        collect_rec(0, out, in_box, in_point);
+    }
+
+    // k points of the cone (as in sector_if) nearest to (x, y), sorted: {d2, id}
+    template <typename Pred>
+    void sector_knn_if(double x, double y, double ax, double ay, double d1x, double d1y, double d2x, double d2y,
+                       size_t k, std::vector<std::pair<double, int>>& out, Pred pred) const
+    {
+        out.clear();
+        if(k == 0 || nodes.empty()) return;
+        Sector sec(ax, ay, d1x, d1y, d2x, d2y);
+        auto in_box = [&](const KDNode& nd) { return sec.may_intersect(nd); };
+        auto in_sector = [&](int id) { return sec.contains(px[where[id]], py[where[id]]) && pred(id); };
+        knn_rec(0, x, y, k, out, in_sector, in_box);
+        std::sort_heap(out.begin(), out.end());
+    }
+};
+
+// Routes shorter than this are ordered faster by the plain linear scan in tsp_approx
+constexpr int NN_TOUR_MIN_KD = 64;
+
+// Greedy nearest neighbour tour over n points starting at point 0: order[i] is the i-th point visited.
+// Ties may be broken differently from the linear scan.
+inline void nearest_neighbour_tour(size_t n, const double* xs, const double* ys, std::vector<int>& order)
+{
+    order.resize(n);
+    if(n == 0) return;
+    KDTree kd(n, xs, ys);
+    int last = 0;
+    order[0] = 0;
+    kd.erase(0);
+    for(size_t i = 1; i < n; i++)
+    {
+        last = kd.nearest(xs[last], ys[last]);
+        kd.erase(last);
+        order[i] = last;
+    }
+}
+
+// Reorders tour[0..n) in place into the nearest neighbour tour from tour[0].
+// x(id) and y(id) give the coordinates of a tour entry.
+template <typename Id, typename GetX, typename GetY>
+void nearest_neighbour_reorder(Id* tour, size_t n, GetX x, GetY y)
+{
+    std::vector<double> xs(n), ys(n);
+    for(size_t i = 0; i < n; i++)
+    {
+        xs[i] = x(tour[i]);
+        ys[i] = y(tour[i]);
+    }
+    std::vector<int> order;
+    nearest_neighbour_tour(n, xs.data(), ys.data(), order);
+    std::vector<Id> unordered(tour, tour + n);
+    for(size_t i = 0; i < n; i++)
+        tour[i] = unordered[order[i]];
+}
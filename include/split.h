@@ -0,0 +1,155 @@
+#pragma once
+
+/*
+Optimal Split of a giant tour into capacity-feasible routes (Prins 2004), in the O(n)
+form of Vidal (2016): Bellman over the tour positions, with the candidate predecessors
+kept in a monotone deque. Unlimited fleet, every route starts and ends at the depot.
+
+Given the same tour, the result is never worse than cutting greedily whenever the
+capacity overflows. Buffers are members and only grow, so one object per thread can
+split millions of tours without allocating.
+*/
+
+#include <vector>
+#include <limits>
+#include <cstddef>
+
+class LinearSplit
+{
+    std::vector<int> cust;          // cust[1..n]: the tour, depot excluded
+    std::vector<double> dist0;      // dist0[i]: depot <-> cust[i]
+    std::vector<double> along;      // along[i]: length of cust[1..i] as a path
+    std::vector<double> load;       // load[i]: demand of cust[1..i]
+    std::vector<double> pot;        // pot[i]: cheapest split of cust[1..i]
+    std::vector<int> pred;          // last cut before position i
+    std::vector<int> deque;
+    int n = 0;
+
+    void reserve(size_t size)
+    {
+        if(cust.size() >= size + 1)
+            return;
+        cust.resize(size + 1);
+        dist0.resize(size + 1);
+        along.resize(size + 1);
+        load.resize(size + 1);
+        pot.resize(size + 1);
+        pred.resize(size + 1);
+        deque.resize(size + 1);
+    }
+
+    // Cost of reaching position j with a route that starts right after position i
+    double propagate(int i, int j) const
+    {
+        return pot[i] + along[j] - along[i + 1] + dist0[i + 1] + dist0[j];
+    }
+
+    // True if predecessor i (< j) is better than j for every later position. Under a hard
+    // capacity only possible if nothing lies between them, else j outlives i in the window.
+    bool dominates(int i, int j) const
+    {
+        return load[i] == load[j]
+               && pot[j] + dist0[j + 1] > pot[i] + dist0[i + 1] + along[j + 1] - along[i + 1];
+    }
+
+    // True if predecessor j (> i) is at least as good as i for every later position
+    bool dominates_right(int i, int j) const
+    {
+        return pot[j] + dist0[j + 1] < pot[i] + dist0[i + 1] + along[j + 1] - along[i + 1] + 1e-9;
+    }
+
+public:
+    // tour[0..size) in visiting order; entries equal to depot are skipped.
+    // dist(a, b) and demand(v) take the same ids as the tour. Returns the total cost, or
+    // +infinity if some customer alone exceeds the capacity: such a tour then loses every
+    // cost comparison, and routes() must not be called for it.
+    template <class Dist, class Demand>
+    double run(const int* tour, size_t size, int depot, double capacity, Dist dist, Demand demand)
+    {
+        reserve(size);
+        n = 0;
+        load[0] = 0;
+        pot[0] = 0;
+        for(size_t k = 0; k < size; k++)
+        {
+            if(tour[k] == depot)
+                continue;
+            n++;
+            cust[n] = tour[k];
+            dist0[n] = dist(depot, tour[k]);
+            load[n] = load[n - 1] + demand(tour[k]);
+            along[n] = (n == 1 ? 0.0 : along[n - 1] + dist(cust[n - 1], tour[k]));
+        }
+        if(n == 0)
+            return 0;
+
+        int front = 0, back = 0;    // deque[front..back]
+        deque[0] = 0;
+        for(int t = 1; t <= n; t++)
+        {
+            if(front > back)
+                return std::numeric_limits<double>::infinity();
+            pot[t] = propagate(deque[front], t);
+            pred[t] = deque[front];
+
+            if(t < n)
+            {
+                if(!dominates(deque[back], t))
+                {
+                    while(back >= front && dominates_right(deque[back], t))
+                        back--;
+                    deque[++back] = t;
+                }
+                while(front <= back && load[t + 1] - load[deque[front]] > capacity)
+                    front++;
+            }
+        }
+        return pot[n];
+    }
+
+    // Routes of the last run(), depot excluded, in tour order
+    void routes(std::vector<std::vector<int>>& out) const
+    {
+        int count = 0;
+        for(int j = n; j > 0; j = pred[j])
+            count++;
+        out.resize(count);
+        for(int j = n, r = count - 1; j > 0; j = pred[j], r--)
+            out[r].assign(cust.begin() + pred[j] + 1, cust.begin() + j + 1);
+    }
+};
+
+// The greedy cut: a new route whenever the next customer overflows the capacity. Same
+// arguments as LinearSplit::run; the fallback for tours it reports +infinity for, as a
+// customer above the capacity then simply gets a route of its own. Routes go to *out
+// (depot excluded) unless out is null. Returns the total cost.
+template <class Dist, class Demand>
+double greedy_split(const int* tour, size_t size, int depot, double capacity, Dist dist, Demand demand,
+                    std::vector<std::vector<int>>* out = nullptr)
+{
+    if(out)
+        out->clear();
+    double cost = 0, residue = capacity;
+    int prev = depot;
+    for(size_t k = 0; k < size; k++)
+    {
+        if(tour[k] == depot)
+            continue;
+        if(prev != depot && residue < demand(tour[k]))
+        {
+            cost += dist(prev, depot);
+            prev = depot;
+            residue = capacity;
+        }
+        if(out && prev == depot)
+            out->emplace_back();
+        cost += dist(prev, tour[k]);
+        residue -= demand(tour[k]);
+        prev = tour[k];
+        if(out)
+            out->back().push_back(tour[k]);
+    }
+    if(prev != depot)
+        cost += dist(prev, depot);
+    return cost;
+}
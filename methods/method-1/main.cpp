@@ -1,5 +1,6 @@
 #include "vrp-single-threaded.h"
 #include "rajesh_codes-single-threaded.h"
+#include "spatial-index.h"
 
 class CommandLineArgs
 {
@@ -74,13 +75,10 @@ void run_our_method(const CVRP& cvrp, Parameters& par, const CommandLineArgs& co
     std::vector <std::vector <Edge>> G(N);
     // Construct auxilary graph G
     {
-        std::priority_queue<
-            Edge,
-            std::vector<Edge>,
-            std::function<bool(const Edge&, const Edge&)>
-        > pq([](const Edge& e1, const Edge& e2) {
-            return e1.w < e2.w;
-        });
+        // Candidates are keyed on their distance from the depot, so every query is centred there
+        KDTree kd;
+        kd.build_from(cvrp.node);
+        std::vector<std::pair<double, int>> nbrs;
 
         for(node_t u = 0; u < N; u++)
         {
@@ -99,38 +97,30 @@ void run_our_method(const CVRP& cvrp, Parameters& par, const CommandLineArgs& co
             Vector vec(cvrp.node[depot].x, cvrp.node[depot].y, cvrp.node[u].x, cvrp.node[u].y);
             Vector vec1(vec, par.get_theta_in_radians());
             Vector vec2(vec, -par.get_theta_in_radians());
-            // pq is empty here
-            
-            for(node_t v = 0; v < N; v++)
-            {
-                if(v == depot || v == u) continue; // Skip depot and self-loops
+
+            // Each vertex is permiited to have at most D neighbours
+            // And these D neighbours are the closest ones outside the angle made between vec1 and vec2 at depot.
+            // The sector (vec1 -> vec2) only prunes tree boxes, the exact test stays is_in_between.
+            auto allowed = [&](int v) {
+                if(v == depot || v == u) return false; // Skip depot and self-loops
                 Vector vecp(cvrp.node[depot].x, cvrp.node[depot].y, cvrp.node[v].x, cvrp.node[v].y);
+                return !vecp.is_in_between(vec1, vec2);
+            };
+            // The box pruning agrees with is_in_between only below 90 degrees; wider angles search unpruned.
+            if(par.get_theta_in_degrees() < 90)
+                kd.sector_knn_if(cvrp.node[depot].x, cvrp.node[depot].y,
+                                 cvrp.node[depot].x, cvrp.node[depot].y, vec1.x, vec1.y, vec2.x, vec2.y,
+                                 par.D, nbrs, allowed);
+            else
+                kd.knn_if(cvrp.node[depot].x, cvrp.node[depot].y, par.D, nbrs, allowed);
 
-                // Checking whether vecp is inside angle made between vec1 and vec2 at depot
-                if(vecp.is_in_between(vec1, vec2))
-                {
-                    continue;
-                }
-                weight_t distance = cvrp.get_distance_on_the_fly(depot, v);
-                // Each vertex is permiited to have at most D neighbours
-                // And these D neighbours are the closest ones
-                if(pq.size() < par.D)
-                {
-                    pq.push(Edge(v, distance));
-                }else if(pq.top().w > distance)
-                {
-                    pq.pop();
-                    pq.push(Edge(v, distance));
-                }
-            }
             // Adding the edges to the auxilary graph G
-            // The edges are directed from u to v
-            while(!pq.empty())
+            // The edges are directed from u to v, farthest first
+            for(int t = (int)nbrs.size() - 1; t >= 0; t--)
             {
-                Edge e = pq.top();
-                pq.pop();
-                G[u].push_back(e);
-                // G[e.v].push_back(Edge(u, e.w)); // Undirected graph
+                node_t v = nbrs[t].second;
+                G[u].push_back(Edge(v, cvrp.get_distance_on_the_fly(depot, v)));
+                // G[v].push_back(Edge(u, e.w)); // Undirected graph
             }
         }
     }
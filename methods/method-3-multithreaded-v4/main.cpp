@@ -1,5 +1,9 @@
 #include "vrp-multi-threaded.h"
 #include "rajesh_codes-multi-threaded.h"
+#include "emst.h"
+#include "split.h"
+#include "random-dfs.h"
+#include <cmath>
 // #include <tbb/concurrent_vector.h> 
 
 class CommandLineArgs
@@ -8,21 +12,25 @@ public:
     std::string input_file_name;
     double alpha;
     int rho;
-    CommandLineArgs(const std::string& file_name, double _alpha, int _rho)
-        : input_file_name(file_name), alpha(_alpha), rho(_rho) {}
+    std::string mst; // prim | delaunay | boruvka
+    std::string split; // greedy | optimal
+    CommandLineArgs(const std::string& file_name, double _alpha, int _rho, const std::string& _mst, const std::string& _split)
+        : input_file_name(file_name), alpha(_alpha), rho(_rho), mst(_mst), split(_split) {}
 };
 
 class CommandLineArgs get_command_line_args(int argc, char* argv[])
 { 
-    if(argc != 4)
+    if(argc < 4 || argc > 6)
     {
-        HANDLE_ERROR(std::string("Usage: ") + argv[0] + " input_file_path --alpha=<alpha> --rho=<rho>");
+        HANDLE_ERROR(std::string("Usage: ") + argv[0] + " input_file_path --alpha=<alpha> --rho=<rho> [--mst=prim|delaunay|boruvka] [--split=greedy|optimal]");
     }
     std::string input_file_name = argv[1];
     if(input_file_name.empty()) HANDLE_ERROR("Input file name cannot be empty.");
 
     double alpha;
     int rho;
+    std::string mst = "prim";
+    std::string split = "greedy";
     for(int i = 2; i < argc; i++)
     {
         std::string arg = argv[i];
@@ -36,11 +44,21 @@ class CommandLineArgs get_command_line_args(int argc, char* argv[])
             rho = std::stoi(arg.substr(6)); // Extract the value after "--rho="
             if(rho <= 0) HANDLE_ERROR("Rho must be a positive integer.");
         }
+        else if(arg.find("--mst=") == 0)
+        {
+            mst = arg.substr(6); // Extract the value after "--mst="
+            if(mst != "prim" && mst != "delaunay" && mst != "boruvka") HANDLE_ERROR("MST must be prim, delaunay or boruvka.");
+        }
+        else if(arg.find("--split=") == 0)
+        {
+            split = arg.substr(8); // Extract the value after "--split="
+            if(split != "greedy" && split != "optimal") HANDLE_ERROR("Split must be greedy or optimal.");
+        }
         else HANDLE_ERROR("Unknown argument: " + arg);
     }
 
     // Create and return the CommandLineArgs object
-    return CommandLineArgs(input_file_name, alpha, rho);
+    return CommandLineArgs(input_file_name, alpha, rho, mst, split);
 }
 
 class CVRP get_cvrp(class CommandLineArgs command_line_args) {
@@ -53,6 +71,8 @@ class Parameters
 public:
     double alpha; // This is in degrees, need not be a multiple of 360
     int rho;
+    std::string mst; // MST of each bucket: prim | delaunay | boruvka
+    std::string split; // DFS order to routes: greedy | optimal
 
     Parameters() {}
     void set_alpha_in_degrees(double _alpha)
@@ -71,6 +91,14 @@ public:
     {
         rho = _rho;
     }
+    void set_mst(const std::string& _mst)
+    {
+        mst = _mst;
+    }
+    void set_split(const std::string& _split)
+    {
+        split = _split;
+    }
     ~Parameters() {}
 };
 
@@ -79,6 +107,8 @@ Parameters get_tunable_parameters(const CommandLineArgs& command_line_args)
     Parameters par;
     par.set_alpha_in_degrees(command_line_args.alpha);  // 5, 10, 25, 50, 75
     par.set_rho(command_line_args.rho);                 // 1e3, 1e4
+    par.set_mst(command_line_args.mst);                 // prim, delaunay, boruvka
+    par.set_split(command_line_args.split);             // greedy, optimal
     return par;
 }
 
@@ -176,6 +206,29 @@ void create_aux_graph(std::vector <std::vector<int>>& adj, std::vector <int>& de
     const int num_nodes = bucket.size();
     if(num_nodes == 1) return;
 
+    if(par.mst == "delaunay" || par.mst == "boruvka") {
+        // Euclidean MST of the bucket: Delaunay triangulation + Kruskal, or parallel Boruvka
+        std::vector<double> xs(num_nodes), ys(num_nodes);
+        for(int i = 0; i < num_nodes; i++) {
+            xs[i] = cvrp.node[bucket[i]].x;
+            ys[i] = cvrp.node[bucket[i]].y;
+        }
+        std::vector<std::pair<int, int>> edges;
+        // One thread: this runs inside the parallel loop over buckets, which already uses them all
+        if(par.mst == "boruvka") boruvka_mst(num_nodes, xs.data(), ys.data(), 1, edges);
+        else                     euclidean_mst(num_nodes, xs.data(), ys.data(), edges);
+        for(const auto& e : edges) {
+            node_t u = bucket[e.first];
+            node_t v = bucket[e.second];
+            if(u != 0) adj[u].push_back(v);
+            else       depot_neighbours.push_back(v);
+
+            if(v != 0) adj[v].push_back(u);
+            else       depot_neighbours.push_back(u);
+        }
+        return;
+    }
+
     MinHeap <MinHeapNode> min_heap(num_nodes);
     std::vector <bool> in_mst(num_nodes, false); // TODO: this can be removed and optimized, we should not create vectors each time you need
 
@@ -251,105 +304,111 @@ void run_our_method(const CVRP& cvrp, const Parameters& par, const CommandLineAr
         weight_t min_cost = INT_MAX;                                                            // taking INT_MAX as infinity
         std::vector <std::vector<int>> min_routes;
         
-        // Search in solution space using randomization
-        // You should enable open mp nested parallelsim
-        // You should check whether rng is thread safe
-        // do you want to use intel vectors which has thread safe push_back???
-        #pragma omp parallel for
-        for(int iter = 1; iter <= par.rho; iter++) {
-            std::random_device rd;
-            std::mt19937 rng(rd());  
-            std::vector <bool> visited(num_nodes, false);
-
-            std::vector<std::vector<node_t>>    curr_routes;
+        // MST of the bucket on local ids (depot is 0), packed once for the iterative DFS
+        std::vector <std::vector<int>> local_adj(num_nodes);
+        local_adj[0] = depot_neighbours;
+        for(int i = 1; i < num_nodes; i++) local_adj[i] = shared_adj[buckets[b][i]];
+        RandomDFS bucket_dfs(local_adj, [&](node_t v) { return reverse_map[v]; });
+
+        // Iteration iter is fully determined by SplitMix64(bucket_seed, iter), so the loop keeps
+        // only costs and the winning iteration is replayed once to build its routes.
+        const bool optimal_split = (par.split == "optimal");                                        // --split=optimal: record the DFS order, split it at the end
+        const uint64_t bucket_seed = std::random_device{}();
+        auto run_iteration = [&](int iter, RandomDFS& dfs, LinearSplit& linear, std::vector<node_t>& tour,
+                                 std::vector<std::vector<node_t>>* routes) -> weight_t {
+            SplitMix64                          rng(bucket_seed, iter);
             weight_t                            curr_total_cost     = 0.0;
             unsigned int                        covered             = 1;                            // Start with depot covered
-            std::vector<node_t>                 current_route;
             capacity_t                          residue_capacity    = cvrp.capacity;
             node_t                              prev_node           = depot;                       // Assuming local id of depot is also depot which is 0 
             weight_t                            curr_route_cost     = 0.0;
 
             // DFS iterative
-            std::stack< std::pair <int, int*>> rec;
-            uint32_t                            neigh_size          = depot_neighbours.size();
-            int32_t*                            neigh               = new int32_t[neigh_size];
-            std::copy(depot_neighbours.begin(), depot_neighbours.end(), neigh);
-            std::shuffle(neigh, neigh + neigh_size, rng);
-            rec.push({neigh_size - 1, neigh});
-            visited[depot]      = true;
-            int index;
-
-            while(!rec.empty()) {
-                index = rec.top().first; 
-                neigh = rec.top().second;
-
-                bool pushed = false;
-                while(index >= 0) {
-                    node_t v        = neigh[index];
-                    node_t v_index  = reverse_map[v];
-                    if(!visited[v_index]) {
-                        if(residue_capacity >= cvrp.node[v].demand) {
-                            current_route.push_back(v);
-                            curr_route_cost     += cvrp.get_distance_on_the_fly(prev_node, v);
-                            residue_capacity    -= cvrp.node[v].demand;
-                            prev_node           = v;                                                            // Update previous node to current vertex
-                        } else {
-                            covered             += current_route.size(); 
-                            curr_routes.push_back(std::move(current_route));
-                            curr_route_cost     += cvrp.get_distance_on_the_fly(prev_node, depot); 
-                            curr_total_cost     += curr_route_cost;
-                            current_route.clear();
-                            prev_node           = depot; 
-                            curr_route_cost     = 0.0; 
-                            residue_capacity    = cvrp.capacity; 
-            
-                            // Start a new route
-                            current_route.push_back(v);
-                            residue_capacity    -= cvrp.node[v].demand;
-                            curr_route_cost     += cvrp.get_distance_on_the_fly(prev_node, v);
-                            prev_node           = v; 
-                        }
-                        visited[v_index]        = true;
-                        rec.top().first         = index - 1; 
-
-                        neigh_size  = shared_adj[v].size();
-                        neigh       = new int[neigh_size];
-                        std::copy(shared_adj[v].begin(), shared_adj[v].end(), neigh);
-                        std::shuffle(neigh, neigh + neigh_size, rng);
-                        rec.push({neigh_size - 1, neigh});
-                        pushed      = true;         
-                        break;
-                    }
-                    index--;
+            tour.clear();
+            dfs.shuffled_walk(0, rng, [&](int v_index) {
+                if(v_index == 0) return true;
+                node_t v = buckets[b][v_index];
+                covered++;
+                if(optimal_split) {
+                    tour.push_back(v);
+                    return true;
                 }
-                if(!pushed) {
-                    free(rec.top().second);
-                    rec.pop();
+                if(residue_capacity >= cvrp.node[v].demand) {
+                    curr_route_cost     += cvrp.get_distance_on_the_fly(prev_node, v);
+                    residue_capacity    -= cvrp.node[v].demand;
+                } else {
+                    curr_route_cost     += cvrp.get_distance_on_the_fly(prev_node, depot); 
+                    curr_total_cost     += curr_route_cost;
+
+                    // Start a new route
+                    curr_route_cost     = cvrp.get_distance_on_the_fly(depot, v);
+                    residue_capacity    = cvrp.capacity - cvrp.node[v].demand;
+                    if(routes) routes->emplace_back();
                 }
-            }
-            
-            // If there are any remaining nodes in the current route, add it to routes
-            if(!current_route.empty()) { 
-                covered         += current_route.size(); 
-                curr_routes.push_back(std::move(current_route));
+                if(routes) {
+                    if(routes->empty()) routes->emplace_back();
+                    routes->back().push_back(v);
+                }
+                prev_node               = v;                                                            // Update previous node to current vertex
+                return true;
+            });
+
+            // Close the last route
+            if(prev_node != depot) { 
                 curr_route_cost += cvrp.get_distance_on_the_fly(prev_node, depot); 
                 curr_total_cost += curr_route_cost; 
             }
 
+            if(optimal_split) {
+                auto dist = [&](node_t u, node_t v) { return cvrp.get_distance_on_the_fly(u, v); };
+                auto demand = [&](node_t v) { return cvrp.node[v].demand; };
+                curr_total_cost = linear.run(tour.data(), tour.size(), depot, cvrp.capacity, dist, demand);
+                if(!std::isfinite(curr_total_cost))                                                 // a customer alone exceeds the capacity: no feasible split, cut greedily
+                    curr_total_cost = greedy_split(tour.data(), tour.size(), depot, cvrp.capacity, dist, demand, routes);
+                else if(routes) linear.routes(*routes);
+            }
+
             if(covered != num_nodes)
             {
                 HANDLE_ERROR("Not all nodes are covered in the bucket " + std::to_string(b) + "! Covered: " + std::to_string(covered) + ", Expected: " + std::to_string(num_nodes));
             }
+            return curr_total_cost;
+        };
 
-            // Step: Update the running total cost
+        // Search in solution space using randomization
+        // You should enable open mp nested parallelsim
+        int min_iter = -1;
+        #pragma omp parallel
+        {
+            RandomDFS dfs = bucket_dfs;                                                             // per-thread copy, no allocation inside the loop
+            LinearSplit linear;
+            std::vector<node_t> tour;
+            weight_t my_cost = INT_MAX;
+            int my_iter = -1;
+
+            #pragma omp for
+            for(int iter = 1; iter <= par.rho; iter++) {
+                weight_t curr_total_cost = run_iteration(iter, dfs, linear, tour, nullptr);
+                if(curr_total_cost < my_cost) {
+                    my_cost = curr_total_cost;
+                    my_iter = iter;
+                }
+            }
+
+            // Step: Update the running total cost, ties to the earliest iteration
             #pragma omp critical
             {
-                if(curr_total_cost < min_cost) {
-                    min_cost   = curr_total_cost;
-                    min_routes = curr_routes; // Update the best routes found so far
+                if(my_iter != -1 && (my_cost < min_cost || (my_cost == min_cost && my_iter < min_iter))) {
+                    min_cost = my_cost;
+                    min_iter = my_iter;
                 }
             }
         }
+        if(min_iter != -1) {
+            LinearSplit linear;
+            std::vector<node_t> tour;
+            run_iteration(min_iter, bucket_dfs, linear, tour, &min_routes);                         // Best routes found, rebuilt once
+        }
 
         if(min_routes.size() != 0)
         {
@@ -1,5 +1,8 @@
 #include "vrp-single-threaded.h"
 #include "rajesh_codes-single-threaded.h"
+#include "emst.h"
+#include "split.h"
+#include <cmath>
 
 class CommandLineArgs
 {
@@ -7,22 +10,26 @@ public:
     std::string input_file_name;
     double alpha;
     int rho;
-    CommandLineArgs(const std::string& file_name, double _alpha, int _rho)
-        : input_file_name(file_name), alpha(_alpha), rho(_rho) {}
+    std::string mst; // prim | delaunay | boruvka
+    std::string split; // greedy | optimal
+    CommandLineArgs(const std::string& file_name, double _alpha, int _rho, const std::string& _mst, const std::string& _split)
+        : input_file_name(file_name), alpha(_alpha), rho(_rho), mst(_mst), split(_split) {}
 };
 
 
 class CommandLineArgs get_command_line_args(int argc, char* argv[])
 {
-    if(argc != 4)
+    if(argc < 4 || argc > 6)
     {
-        HANDLE_ERROR(std::string("Usage: ") + argv[0] + " input_file_path --alpha=<alpha> --rho=<rho>");
+        HANDLE_ERROR(std::string("Usage: ") + argv[0] + " input_file_path --alpha=<alpha> --rho=<rho> [--mst=prim|delaunay|boruvka] [--split=greedy|optimal]");
     }
     std::string input_file_name = argv[1];
     if(input_file_name.empty()) HANDLE_ERROR("Input file name cannot be empty.");
 
     double alpha;
     int rho;
+    std::string mst = "prim";
+    std::string split = "greedy";
     for(int i = 2; i < argc; i++)
     {
         std::string arg = argv[i];
@@ -36,11 +43,21 @@ class CommandLineArgs get_command_line_args(int argc, char* argv[])
             rho = std::stoi(arg.substr(6)); // Extract the value after "--rho="
             if(rho <= 0) HANDLE_ERROR("Rho must be a positive integer.");
         }
+        else if(arg.find("--mst=") == 0)
+        {
+            mst = arg.substr(6); // Extract the value after "--mst="
+            if(mst != "prim" && mst != "delaunay" && mst != "boruvka") HANDLE_ERROR("MST must be prim, delaunay or boruvka.");
+        }
+        else if(arg.find("--split=") == 0)
+        {
+            split = arg.substr(8); // Extract the value after "--split="
+            if(split != "greedy" && split != "optimal") HANDLE_ERROR("Split must be greedy or optimal.");
+        }
         else HANDLE_ERROR("Unknown argument: " + arg);
     }
 
     // Create and return the CommandLineArgs object
-    return CommandLineArgs(input_file_name, alpha, rho);
+    return CommandLineArgs(input_file_name, alpha, rho, mst, split);
 }
 
 class CVRP get_cvrp(class CommandLineArgs command_line_args)
@@ -54,6 +71,8 @@ class Parameters
 public:
     double alpha; // This is in degrees, need not be a multiple of 360
     int rho;
+    std::string mst; // MST of each bucket: prim | delaunay | boruvka
+    std::string split; // DFS order to routes: greedy | optimal
 
     Parameters() {}
     void set_alpha_in_degrees(double _alpha)
@@ -72,6 +91,14 @@ public:
     {
         rho = _rho;
     }
+    void set_mst(const std::string& _mst)
+    {
+        mst = _mst;
+    }
+    void set_split(const std::string& _split)
+    {
+        split = _split;
+    }
     ~Parameters() {}
 };
 
@@ -80,6 +107,8 @@ Parameters get_tunable_parameters(const CommandLineArgs& command_line_args)
     Parameters par;
     par.set_alpha_in_degrees(command_line_args.alpha);  // 5, 10, 25, 50, 75
     par.set_rho(command_line_args.rho);                 // 1e3, 1e4
+    par.set_mst(command_line_args.mst);                 // prim, delaunay, boruvka
+    par.set_split(command_line_args.split);             // greedy, optimal
     return par;
 }
 
@@ -224,6 +253,38 @@ public:
         return;
     }
 
+    // Euclidean MST of the bucket without the lazy heap: Delaunay triangulation + Kruskal in
+    // O(n log n), or Boruvka (parallel when built with OpenMP).
+    // The dense distance table is still filled, the routes are costed from it.
+    void construct_EMST(const std::vector<node_t>& bucket, const CVRP& cvrp, const std::string& mst)
+    {
+        if(num_nodes == 1) return;
+
+        int dist_index = 0;
+        for(int u_index = 0; u_index < num_nodes; u_index++)
+        {
+            for(int v_index = u_index + 1; v_index < num_nodes; v_index++)
+            {
+                dist[dist_index++] = cvrp.get_distance_on_the_fly(bucket[u_index], bucket[v_index]);
+            }
+        }
+
+        std::vector<double> xs(num_nodes), ys(num_nodes);
+        for(int u_index = 0; u_index < num_nodes; u_index++)
+        {
+            xs[u_index] = cvrp.node[bucket[u_index]].x;
+            ys[u_index] = cvrp.node[bucket[u_index]].y;
+        }
+        std::vector<std::pair<int, int>> edges;
+        if(mst == "boruvka") boruvka_mst(num_nodes, xs.data(), ys.data(), 0, edges);
+        else                 euclidean_mst(num_nodes, xs.data(), ys.data(), edges);
+        for(const auto& e : edges)
+        {
+            adj[e.first].push_back(e.second);
+            adj[e.second].push_back(e.first);
+        }
+    }
+
     // Construct graph for the bucket
     Graph(const std::vector<node_t>& bucket, const CVRP& cvrp, const Parameters& par, int mst_start_vertex  = 0)
     {
@@ -235,7 +296,8 @@ public:
         adj.reserve(num_nodes);
         adj.resize(num_nodes);
 
-        construct_MST(bucket, cvrp, mst_start_vertex);
+        if(par.mst == "prim") construct_MST(bucket, cvrp, mst_start_vertex);
+        else                  construct_EMST(bucket, cvrp, par.mst);
     }
     ~Graph() {}
 
@@ -289,6 +351,11 @@ void run_our_method(const CVRP& cvrp, const Parameters& par, const CommandLineAr
         std::vector <std::vector<int>> min_routes;
         int num_nodes = buckets[b].size();
 
+        // --split=optimal: the DFS order is only recorded and split optimally at the end
+        const bool optimal_split = (par.split == "optimal");
+        LinearSplit linear;
+        std::vector<node_t> tour;
+
         // Search in solution space using randomization
         for(int iter = 1; iter <= par.rho; iter++)
         {
@@ -309,11 +376,15 @@ void run_our_method(const CVRP& cvrp, const Parameters& par, const CommandLineAr
                 node_t prev_node = depot;                       // Assuming local id of depot is also depot which is 0 
                 weight_t curr_route_cost = 0.0;
 
-                // DFS iterative
+                // DFS iterative, abandoned as soon as the partial cost reaches min_cost: the
+                // remaining legs can only add to it, so such a tour can never be the new best.
+                // Greedy split only: an optimal split of the whole tour may still be cheaper.
+                bool pruned = false;
+                tour.clear();
                 std::stack< std::pair <node_t, int>> rec;
                 rec.push({depot, 0}); // Start from depot
                 visited[depot] = true;
-                while(!rec.empty())
+                while(!rec.empty() && !pruned)
                 {
                     auto [u, index] = rec.top();
                     while(index < aux_graph.adj[u].size())
@@ -321,7 +392,10 @@ void run_our_method(const CVRP& cvrp, const Parameters& par, const CommandLineAr
                         node_t v = aux_graph.adj[u][index];
                         if(!visited[v])
                         {
-                            if(residue_capacity >= cvrp.node[buckets[b][v]].demand)
+                            if(optimal_split)
+                            {
+                                tour.push_back(v);
+                            }else if(residue_capacity >= cvrp.node[buckets[b][v]].demand)
                             {
                                 current_route.push_back(v);
                                 curr_route_cost += aux_graph.get_distance_stored(prev_node, v);
@@ -345,6 +419,11 @@ void run_our_method(const CVRP& cvrp, const Parameters& par, const CommandLineAr
                                 prev_node = v; // Update previous node to current vertex
                             }
                             visited[v] = true;
+                            if(!optimal_split && curr_total_cost + curr_route_cost >= min_cost)
+                            {
+                                pruned = true;
+                                break;
+                            }
                             rec.top().second = index + 1; // Update index for next iteration
                             rec.push({v, 0});           // Push next vertex to stack
                             break;
@@ -357,6 +436,8 @@ void run_our_method(const CVRP& cvrp, const Parameters& par, const CommandLineAr
                     }
                 }
 
+                if(pruned) continue;
+
                 // If there are any remaining nodes in the current route, add it to routes
                 if(!current_route.empty())
                 { 
@@ -365,6 +446,18 @@ void run_our_method(const CVRP& cvrp, const Parameters& par, const CommandLineAr
                     curr_route_cost += aux_graph.get_distance_stored(prev_node, depot); // Add cost to return to depot
                     curr_total_cost += curr_route_cost; // Add the cost of the last route
                 }
+
+                if(optimal_split)
+                {
+                    covered += tour.size();
+                    auto dist = [&](node_t a, node_t c) { return aux_graph.get_distance_stored(a, c); };
+                    auto demand = [&](node_t v) { return cvrp.node[buckets[b][v]].demand; };
+                    curr_total_cost = linear.run(tour.data(), tour.size(), depot, cvrp.capacity, dist, demand);
+                    if(std::isfinite(curr_total_cost))
+                        linear.routes(curr_routes);
+                    else // a customer alone exceeds the capacity: no feasible split, cut greedily
+                        curr_total_cost = greedy_split(tour.data(), tour.size(), depot, cvrp.capacity, dist, demand, &curr_routes);
+                }
             }
 
             if(covered != num_nodes)
@@ -376,7 +469,7 @@ void run_our_method(const CVRP& cvrp, const Parameters& par, const CommandLineAr
             if(curr_total_cost < min_cost)
             {
                 min_cost = curr_total_cost;
-                min_routes = curr_routes; // Update the best routes found so far
+                min_routes = std::move(curr_routes); // Update the best routes found so far
             }
         }
 
@@ -365,11 +365,13 @@ void run_our_method(const CVRP& cvrp, const Parameters& par, const CommandLineAr
                         node_t prev_node = depot;                       // Assuming local id of depot is also depot which is 0 
                         weight_t curr_route_cost = 0.0;
 
-                        // DFS iterative
+                        // DFS iterative, abandoned as soon as the partial cost reaches min_cost: the
+                        // remaining legs can only add to it, so such a tour can never be the new best
+                        bool pruned = false;
                         std::stack< std::pair <node_t, int>> rec;
                         rec.push({depot, 0}); // Start from depot
                         visited[depot] = true;
-                        while(!rec.empty())
+                        while(!rec.empty() && !pruned)
                         {
                             auto top = rec.top();
                             node_t u = top.first;
@@ -404,6 +406,11 @@ void run_our_method(const CVRP& cvrp, const Parameters& par, const CommandLineAr
                                         prev_node = v;      // Update previous node to current vertex
                                     }
                                     visited[v] = true;
+                                    if(curr_total_cost + curr_route_cost >= min_cost)
+                                    {
+                                        pruned = true;
+                                        break;
+                                    }
                                     rec.top().second = index + 1;   // Update index for next iteration
                                     rec.push({v, 0});               // Push next vertex to stack
                                     break;
@@ -416,6 +423,8 @@ void run_our_method(const CVRP& cvrp, const Parameters& par, const CommandLineAr
                             }
                         }
 
+                        if(pruned) continue;
+
                         // If there are any remaining nodes in the current route, add it to routes
                         if(!current_route.empty())
                         { 
@@ -434,7 +443,7 @@ void run_our_method(const CVRP& cvrp, const Parameters& par, const CommandLineAr
                     if(curr_total_cost < min_cost)
                     {
                         min_cost = curr_total_cost;
-                        min_routes = curr_routes; // Update the best routes found so far
+                        min_routes = std::move(curr_routes); // Update the best routes found so far
                     }
                 }
             }
@@ -1,6 +1,6 @@
 //~~~START:Thu, 16-Jun-2022, 12:43:32 IST
 // For GECCO'23 Submission.
-// g++ -O3 -Wall -o "seqMDS".out "seqMDS.cpp"  -std=c++14
+// g++ -O3 -Wall -o "seqMDS".out "seqMDS.cpp"  -std=c++14 -I../../include
 
 /*
  * Rajesh Pandian M | https://mrprajesh.co.in
@@ -14,6 +14,7 @@
 #include <set>
 #include <algorithm>
 #include <cfloat>
+#include <cmath>
 #include <climits>
 #include <cstring>
 #include <iomanip>
@@ -23,6 +24,11 @@
 #include <random>
 #include <chrono>  //timing CPU
 
+#include "spatial-index.h"
+#include "split.h"
+#include "route-search.h"
+#include "held-karp.h"
+
 unsigned DEBUGCODE = 0;
 #define DEBUG if (DEBUGCODE)
 
@@ -42,10 +48,12 @@ class Params {
   Params() {
     toRound = 1;  // DEFAULT is round
     //~ nThreads = 20; // DEFAULT is 20 OMP threads
+    split = "greedy";  // DEFAULT is the greedy cut of convertToVrpRoutes
   }
   ~Params() {}
 
   bool toRound;
+  string split;  // greedy | optimal
   //~ short nThreads;
 };
 
@@ -346,6 +354,22 @@ convertToVrpRoutes(const VRP &vrp, const std::vector<node_t> &singleRoute) {
   return routes;
 }
 
+// Routes of a permutation: the greedy cut above, or the optimal split (-split optimal)
+std::vector<std::vector<node_t>>
+splitRoutes(const VRP &vrp, const std::vector<node_t> &singleRoute, LinearSplit &linear) {
+  if (vrp.params.split != "optimal")
+    return convertToVrpRoutes(vrp, singleRoute);
+
+  std::vector<std::vector<node_t>> routes;
+  double cost = linear.run(singleRoute.data(), singleRoute.size(), DEPOT, vrp.getCapacity(),
+                           [&vrp](node_t a, node_t b) { return vrp.get_dist(a, b); },
+                           [&vrp](node_t v) { return vrp.node[v].demand; });
+  if (!std::isfinite(cost))  // no feasible split: routes() would read a stale pred[]
+    return convertToVrpRoutes(vrp, singleRoute);
+  linear.routes(routes);
+  return routes;
+}
+
 // Cost of a CVRP Solution!.
 weight_t calRouteValue(const VRP &vrp, const std::vector<node_t> &aRoute, node_t depot = 1) {  //return cost of "a" route
   weight_t routeVal = 0;
@@ -405,6 +429,12 @@ void tsp_approx(const VRP &vrp, std::vector<node_t> &cities, std::vector<node_t>
 
   tour[0] = cities[ncities - 1];
 
+  if (ncities >= NN_TOUR_MIN_KD) {  // long route: nearest unvisited point from the k-d tree
+    nearest_neighbour_reorder(tour.data(), ncities, [&vrp](node_t v) { return vrp.node[v].x; },
+                              [&vrp](node_t v) { return vrp.node[v].y; });
+    return;
+  }
+
   for (i = 1; i < ncities; i++) {
     //~ double ThisX = points.x_coords[tour[i-1]];
     //~ double ThisY = points.y_coords[tour[i-1]];
@@ -461,60 +491,10 @@ postprocess_tsp_approx(const VRP &vrp, std::vector<std::vector<node_t>> &solRout
   return modifiedRoutes;
 }
 
-void tsp_2opt(const VRP &vrp, std::vector<node_t> &cities, std::vector<node_t> &tour, unsigned ncities) {
-  // 'cities' contains the original solution. It is updated during the course of the 2opt-scheme to contain the 2opt soln.
-  // 'tour' is an auxillary array.
-
-  // repeat until no improvement is made
-  unsigned improve = 0;
-
-  while (improve < 2) {
-    double best_distance = 0.0;
-
-    best_distance += vrp.get_dist(DEPOT, cities[0]);  // computing distance of the first point in the route with the depot.
-
-    for (unsigned jj = 1; jj < ncities; ++jj) {
-      best_distance += vrp.get_dist(cities[jj - 1], cities[jj]);
-    }
-
-    best_distance += vrp.get_dist(DEPOT, cities[ncities - 1]);
-    // 1x 2x 3x 4 5
-    //  1 2  3  4 5
-    for (unsigned i = 0; i < ncities - 1; i++) {
-      for (unsigned k = i + 1; k < ncities; k++) {
-        for (unsigned c = 0; c < i; ++c) {
-          tour[c] = cities[c];
-        }
-
-        unsigned dec = 0;
-        for (unsigned c = i; c < k + 1; ++c) {
-          tour[c] = cities[k - dec];
-          dec++;
-        }
-
-        for (unsigned c = k + 1; c < ncities; ++c) {
-          tour[c] = cities[c];
-        }
-        double new_distance = 0.0;
-
-        new_distance += vrp.get_dist(DEPOT, tour[0]);
-        for (unsigned jj = 1; jj < ncities; ++jj) {
-          new_distance += vrp.get_dist(tour[jj - 1], tour[jj]);
-        }
-
-        new_distance += vrp.get_dist(DEPOT, tour[ncities - 1]);
-
-        if (new_distance < best_distance) {
-          // Improvement found so reset
-          improve = 0;
-          for (unsigned jj = 0; jj < ncities; jj++)
-            cities[jj] = tour[jj];
-          best_distance = new_distance;
-        }
-      }
-    }
-    improve++;
-  }
+void tsp_2opt(const VRP &vrp, std::vector<node_t> &cities, unsigned ncities) {
+  // 'cities' contains the original solution. It is updated in place to contain the 2opt soln.
+  optimise_route(cities.data(), ncities, (node_t)DEPOT, [&vrp](node_t a, node_t b) { return vrp.get_dist(a, b); },
+                 [&vrp](node_t v) { return vrp.node[v].x; }, [&vrp](node_t v) { return vrp.node[v].y; });
 }
 
 std::vector<std::vector<node_t>>
@@ -527,7 +507,6 @@ postprocess_2OPT(const VRP &vrp, std::vector<std::vector<node_t>> &final_routes)
     unsigned sz = final_routes[i].size();
 
     std::vector<node_t> cities(sz);
-    std::vector<node_t> tour(sz);
 
     for (unsigned j = 0; j < sz; ++j)
       cities[j] = final_routes[i][j];
@@ -535,7 +514,7 @@ postprocess_2OPT(const VRP &vrp, std::vector<std::vector<node_t>> &final_routes)
     vector<node_t> curr_route;
 
     if (sz > 2)                         // for sz <= 1, the cost of the path cannot change. So no point running this.
-      tsp_2opt(vrp, cities, tour, sz);  //MAIN
+      tsp_2opt(vrp, cities, sz);  //MAIN
 
     for (unsigned kk = 0; kk < sz; ++kk) {
       curr_route.push_back(cities[kk]);
@@ -676,16 +655,18 @@ int main(int argc, char *argv[]) {
   VRP vrp;
   if (argc < 2) {
     std::cout << "seqMDS version 1.1" << '\n';
-    std::cout << "Usage: " << argv[0] << " toy.vrp [-round 0 or 1 DEFAULT:1 means round it!]" << '\n';
+    std::cout << "Usage: " << argv[0] << " toy.vrp [-round 0 or 1 DEFAULT:1 means round it!] [-split greedy or optimal DEFAULT:greedy]" << '\n';
     exit(1);
   }
 
   for (int ii = 2; ii < argc; ii += 2) {
     if (std::string(argv[ii]) == "-round")
       vrp.params.toRound = atoi(argv[ii + 1]);
+    else if (std::string(argv[ii]) == "-split" && (std::string(argv[ii + 1]) == "greedy" || std::string(argv[ii + 1]) == "optimal"))
+      vrp.params.split = argv[ii + 1];
     else {
       std::cerr << "INVALID Arguments!" << '\n';
-      std::cerr << "Usage:" << argv[0] << " toy.vrp -round 1" << '\n';
+      std::cerr << "Usage:" << argv[0] << " toy.vrp -round 1 -split greedy" << '\n';
       exit(1);
     }
   }
@@ -705,6 +686,7 @@ int main(int argc, char *argv[]) {
 
   weight_t minCost = INT_MAX * 1.0f;
   std::vector<std::vector<node_t>> minRoute;
+  LinearSplit linear;
 
   for (int i = 0; i < 1; ++i) {
     // RANDOMIZE THE ADJ LIST OF MST
@@ -721,7 +703,7 @@ int main(int argc, char *argv[]) {
     ShortCircutTour(mstG, visited, 0, singleRoute);  //a DFS
     DEBUG std::cout << '\n';
 
-    auto aRoutes = convertToVrpRoutes(vrp, singleRoute);
+    auto aRoutes = splitRoutes(vrp, singleRoute, linear);
 
     auto aCostRoute = calCost(vrp, aRoutes);
 
@@ -749,7 +731,7 @@ int main(int argc, char *argv[]) {
     ShortCircutTour(mstG, visited, 0, singleRoute);  //a DFS
     DEBUG std::cout << '\n';
 
-    auto aRoutes = convertToVrpRoutes(vrp, singleRoute);
+    auto aRoutes = splitRoutes(vrp, singleRoute, linear);
 
     auto aCostRoute = calCost(vrp, aRoutes);
 
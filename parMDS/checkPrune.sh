@@ -0,0 +1,29 @@
+#!/bin/bash
+# -prune only skips tours that cannot win, so for a fixed -seed every -prune level must
+# report the same costs as -prune 0. Usage: ./checkPrune.sh [parMDS binary] [instances...]
+EXE=${1:-./parMDS.out}
+shift
+FILES=${@:-"inputs/E-n101-k8.vrp inputs/CMT5.vrp inputs/Golden_12.vrp inputs/tai385.vrp"}
+
+status=0
+for file in $FILES
+do
+  for seed in 0 7
+  do
+    ref=$($EXE $file -nthreads 4 -seed $seed -prune 0 2>&1 >/dev/null | awk '{print $3, $4, $5}')
+    if [ -z "$ref" ]; then
+      echo "$file -seed $seed: no cost reported"
+      status=1
+    fi
+    for prune in 1 2
+    do
+      got=$($EXE $file -nthreads 4 -seed $seed -prune $prune 2>&1 >/dev/null | awk '{print $3, $4, $5}')
+      if [ "$got" != "$ref" ]; then
+        echo "$file -seed $seed: -prune $prune gives $got, -prune 0 gives $ref"
+        status=1
+      fi
+    done
+  done
+  echo $file - Done
+done
+exit $status
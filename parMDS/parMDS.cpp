@@ -1,6 +1,6 @@
 //~~~START:Thu, 16-Jun-2022, 12:43:32 IST
 // For GECCO'23 Submission.
-// nvc++ -O3 -std=c++14 -acc=multicore  parMDS.cpp -o parMDS.out && time ./parMDS.out toy.vrp 32
+// nvc++ -O3 -std=c++14 -acc=multicore -I../include parMDS.cpp -o parMDS.out && time ./parMDS.out toy.vrp 32
 /*
  * Rajesh Pandian M | https://mrprajesh.co.in
  * Somesh Singh     | https://ssomesh.github.io
@@ -14,6 +14,7 @@
 #include <set>
 #include <algorithm>
 #include <cfloat>
+#include <cmath>
 #include <climits>
 #include <cstring>
 #include <iomanip>
@@ -22,6 +23,17 @@
 
 #include <random>
 #include <chrono>  //timing CPU
+#include <atomic>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "spatial-index.h"
+#include "emst.h"
+#include "random-dfs.h"
+#include "split.h"
+#include "route-search.h"
+#include "held-karp.h"
 
 unsigned DEBUGCODE = 0;
 #define DEBUG if (DEBUGCODE)
@@ -42,11 +54,21 @@ class Params {
   Params() {
     toRound = 1;    // DEFAULT is round
     nThreads = 20;  // DEFAULT is 20 OMP threads
+    kNN = 0;        // DEFAULT is 0, i.e. complete graph
+    mst = "prim";   // DEFAULT is Prim's on the candidate graph
+    seed = 0;       // DEFAULT is 0
+    prune = 1;      // DEFAULT is 1, cut tours by their partial cost
+    split = "greedy";  // DEFAULT is the greedy cut of convertToVrpRoutes
   }
   ~Params() {}
 
   bool toRound;
   short nThreads;
+  unsigned kNN;  // > 0 means sparse candidate graph with kNN neighbours per node
+  string mst;    // prim | delaunay | boruvka
+  unsigned seed;  // base seed of the per-thread RNG streams
+  short prune;    // 0: off, 1: partial cost, 2: partial cost + lower bound of the rest
+  string split;   // greedy | optimal
 };
 
 class Edge {
@@ -88,9 +110,14 @@ class VRP {
   void print_dist();
 
   std::vector<std::vector<Edge>> cal_graph_dist();
+  std::vector<std::vector<Edge>> cal_graph_knn();
   weight_t get_dist(node_t i, node_t j) const {
     if (i == j)
       return 0.0;
+    if (dist.empty()) {  // sparse mode has no distance table. Compute on the fly.
+      weight_t w = sqrt(((node[i].x - node[j].x) * (node[i].x - node[j].x)) + ((node[i].y - node[j].y) * (node[i].y - node[j].y)));
+      return (params.toRound ? round(w) : w);
+    }
     node_t temp;
     if (i > j) {
       temp = i;
@@ -143,6 +170,86 @@ VRP::cal_graph_dist() {
   return nG;
 }
 
+// Sparse candidate graph: every node is joined to its kNN nearest neighbours (k-d tree, O(n log n)).
+// No n(n-1)/2 distance table is kept; get_dist() computes on the fly.
+// Edge lengths are unrounded, same as cal_graph_dist().
+std::vector<std::vector<Edge>>
+VRP::cal_graph_knn() {
+  std::vector<double> xs(size), ys(size);
+  for (size_t i = 0; i < size; ++i) {
+    xs[i] = node[i].x;
+    ys[i] = node[i].y;
+  }
+  KDTree tree(size, xs.data(), ys.data());
+
+  // undirected edges as (min, max) pairs; sorted to drop duplicates
+  std::vector<std::pair<node_t, node_t>> edges;
+  edges.reserve(size * params.kNN);
+  std::vector<std::pair<double, int>> nbrs;
+  for (size_t i = 0; i < size; ++i) {
+    tree.knn(xs[i], ys[i], params.kNN, nbrs, i);
+    for (auto &nb : nbrs)
+      edges.push_back({std::min<node_t>(i, nb.second), std::max<node_t>(i, nb.second)});
+  }
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+  // kNN graphs of clustered instances can be disconnected. Join every component
+  // (other than the largest) to its nearest foreign node until one is left.
+  std::vector<node_t> comp(size);
+  auto find = [&comp](node_t u) {
+    while (comp[u] != u)
+      u = comp[u] = comp[comp[u]];
+    return u;
+  };
+  for (size_t i = 0; i < size; ++i)
+    comp[i] = i;
+  size_t nComps = size;
+  for (auto &e : edges) {
+    node_t a = find(e.first), b = find(e.second);
+    if (a != b) {
+      comp[a] = b;
+      nComps--;
+    }
+  }
+  while (nComps > 1) {
+    std::vector<size_t> compSize(size, 0);
+    for (size_t i = 0; i < size; ++i)
+      compSize[find(i)]++;
+    node_t largest = std::max_element(compSize.begin(), compSize.end()) - compSize.begin();
+
+    std::vector<std::pair<weight_t, std::pair<node_t, node_t>>> best(size, {DBL_MAX, {-1, -1}});
+    for (size_t i = 0; i < size; ++i) {
+      node_t c = find(i);
+      if (c == largest)
+        continue;
+      double d2;
+      node_t j = tree.nearest_if(xs[i], ys[i], [&](int id) { return find(id) != c; }, &d2);
+      if (j >= 0 && d2 < best[c].first)
+        best[c] = {d2, {(node_t)i, j}};
+    }
+    for (auto &b : best) {
+      if (b.second.first < 0)
+        continue;
+      node_t u = b.second.first, v = b.second.second;
+      edges.push_back({std::min(u, v), std::max(u, v)});
+      node_t cu = find(u), cv = find(v);
+      if (cu != cv) {
+        comp[cu] = cv;
+        nComps--;
+      }
+    }
+  }
+
+  std::vector<std::vector<Edge>> nG(size);
+  for (auto &e : edges) {
+    weight_t w = sqrt(((node[e.first].x - node[e.second].x) * (node[e.first].x - node[e.second].x)) + ((node[e.first].y - node[e.second].y) * (node[e.first].y - node[e.second].y)));
+    nG[e.first].push_back(Edge(e.second, w));
+    nG[e.second].push_back(Edge(e.first, w));
+  }
+  return nG;
+}
+
 // Prints distance of every pair of nodes
 void VRP::print_dist() {
   for (size_t i = 0; i < size; ++i) {
@@ -288,6 +395,60 @@ PrimsAlgo(const VRP &vrp, std::vector<std::vector<Edge>> &graph) {
   return nG;
 }
 
+// Adjacency of a tree given by its edges, laid out exactly as PrimsAlgo does (node u, then its parent),
+// so every MST backend gives the same lists for the same tree.
+std::vector<std::vector<Edge>>
+treeAdjList(const VRP &vrp, const std::vector<std::pair<node_t, node_t>> &edges) {
+  auto N = vrp.getSize();
+  std::vector<node_t> toEdges;
+  tree_parents(N, edges, DEPOT, toEdges);
+
+  std::vector<std::vector<Edge>> nG(N);
+  for (node_t u = 0; u < (node_t)N; u++) {
+    node_t v = toEdges[u];
+    if (v != -1) {
+      weight_t w = vrp.get_dist(u, v);
+      nG[u].push_back(Edge(v, w));
+      nG[v].push_back(Edge(u, w));
+    }
+  }
+  return nG;
+}
+
+// Euclidean MST from the Delaunay triangulation, O(n log n). Needs no candidate graph.
+std::vector<std::vector<Edge>>
+DelaunayMST(const VRP &vrp) {
+  auto N = vrp.getSize();
+  std::vector<double> xs(N), ys(N);
+  for (size_t i = 0; i < N; ++i) {
+    xs[i] = vrp.node[i].x;
+    ys[i] = vrp.node[i].y;
+  }
+  std::vector<std::pair<node_t, node_t>> edges;
+  euclidean_mst(N, xs.data(), ys.data(), edges);
+  return treeAdjList(vrp, edges);
+}
+
+// Parallel Boruvka on nThreads: over the kNN candidate graph when -knn is given,
+// otherwise over the implicit complete graph (nearest other-component node from a k-d tree).
+std::vector<std::vector<Edge>>
+BoruvkaMST(VRP &vrp) {
+  auto N = vrp.getSize();
+  std::vector<std::pair<node_t, node_t>> edges;
+  if (vrp.params.kNN > 0) {
+    auto cG = vrp.cal_graph_knn();
+    boruvka_mst(cG, vrp.params.nThreads, edges);
+  } else {
+    std::vector<double> xs(N), ys(N);
+    for (size_t i = 0; i < N; ++i) {
+      xs[i] = vrp.node[i].x;
+      ys[i] = vrp.node[i].y;
+    }
+    boruvka_mst(N, xs.data(), ys.data(), vrp.params.nThreads, edges);
+  }
+  return treeAdjList(vrp, edges);
+}
+
 // Graph's Adjacency information.
 void printAdjList(const std::vector<std::vector<Edge>> &graph) {
   int i = 0;
@@ -301,20 +462,6 @@ void printAdjList(const std::vector<std::vector<Edge>> &graph) {
   }
 }
 
-// DFS Recursive.
-void ShortCircutTour(std::vector<std::vector<Edge>> &g, std::vector<bool> &visited, node_t u, std::vector<node_t> &out) {
-  visited[u] = true;
-  DEBUG std::cout << u << ' ';
-  //! cvrpInOut.addRouteVertex(u);
-  out.push_back(u);
-  for (auto e : g[u]) {
-    node_t v = e.to;
-    if (!visited[v]) {
-      ShortCircutTour(g, visited, v, out);
-    }
-  }
-}
-
 // Converts a permutation to set of routes
 std::vector<std::vector<node_t>>
 convertToVrpRoutes(const VRP &vrp, const std::vector<node_t> &singleRoute) {
@@ -341,6 +488,89 @@ convertToVrpRoutes(const VRP &vrp, const std::vector<node_t> &singleRoute) {
   return routes;
 }
 
+// Cheap lower bound on the part of a tour not walked yet. Both edges of an unvisited customer
+// are still to come: together at least its 1st + 2nd nearest-neighbour distance, or twice its
+// depot distance if it ends up alone on a route (both edges to the depot), whichever is less.
+// Halved, so that edges between two unvisited customers are not counted twice; the depot end of
+// the final return adds half the shortest edge into the depot.
+struct TailBound {
+  std::vector<weight_t> nn;  // min(1st + 2nd nearest-neighbour distance, 2 * depot distance) / 2
+  weight_t nnSum = 0;        // over the customers
+  weight_t depotIn = 0;      // half the shortest edge into the depot
+};
+
+TailBound calTailBound(const VRP &vrp) {
+  size_t size = vrp.getSize();
+  std::vector<double> xs(size), ys(size);
+  for (size_t i = 0; i < size; ++i) {
+    xs[i] = vrp.node[i].x;
+    ys[i] = vrp.node[i].y;
+  }
+  KDTree tree(size, xs.data(), ys.data());
+
+  TailBound tb;
+  tb.nn.assign(size, 0);
+  tb.depotIn = DBL_MAX;
+  std::vector<std::pair<double, int>> nbrs;
+  for (size_t i = 0; i < size; ++i) {
+    tree.knn(xs[i], ys[i], 2, nbrs, i);
+    for (auto &nb : nbrs)
+      tb.nn[i] += vrp.get_dist(i, nb.second) / 2;
+    if (i != DEPOT) {
+      tb.nn[i] = std::min(tb.nn[i], vrp.get_dist(i, DEPOT));
+      tb.nnSum += tb.nn[i];
+      tb.depotIn = std::min(tb.depotIn, vrp.get_dist(i, DEPOT));
+    }
+  }
+  tb.depotIn = (size < 2 ? 0 : tb.depotIn / 2);
+  return tb;
+}
+
+// convertToVrpRoutes + calCost in one pass: fed the DFS order vertex by vertex, it keeps only
+// the open route's residue and cost. Same splits and same summation order as the two calls.
+class SplitCost {
+  public:
+  SplitCost(const VRP &vrp, const TailBound *tb = nullptr) : vrp(vrp), tb(tb) { reset(); }
+
+  void reset() {
+    residueCap = vrp.getCapacity();
+    last = DEPOT;
+    routeCost = 0;
+    total = 0;
+    rest = (tb ? tb->nnSum : 0);
+  }
+
+  void add(node_t v) {
+    if (v == DEPOT)
+      return;
+    if (tb)
+      rest -= tb->nn[v];
+    if (residueCap - vrp.node[v].demand >= 0) {
+      routeCost += vrp.get_dist(last, v);
+      residueCap = residueCap - vrp.node[v].demand;
+    } else {  //new route
+      total += routeCost + vrp.get_dist(DEPOT, last);
+      routeCost = vrp.get_dist(DEPOT, v);
+      residueCap = vrp.getCapacity() - vrp.node[v].demand;
+    }
+    last = v;
+  }
+
+  weight_t finish() const { return total + (routeCost + vrp.get_dist(DEPOT, last)); }
+
+  // Never above finish(): the cost so far, plus the TailBound of the rest if one was given.
+  weight_t lower() const { return (tb ? total + routeCost + (rest + tb->depotIn) : total + routeCost); }
+
+  private:
+  const VRP &vrp;
+  const TailBound *tb;
+  weight_t rest;  // TailBound of the customers not added yet
+  demand_t residueCap;
+  node_t last;
+  weight_t routeCost;
+  weight_t total;
+};
+
 // Cost of a CVRP Solution!.
 weight_t calRouteValue(const VRP &vrp, const std::vector<node_t> &aRoute, node_t depot = 1) {  //return cost of "a" route
   weight_t routeVal = 0;
@@ -400,6 +630,12 @@ void tsp_approx(const VRP &vrp, std::vector<node_t> &cities, std::vector<node_t>
 
   tour[0] = cities[ncities - 1];
 
+  if (ncities >= NN_TOUR_MIN_KD) {  // long route: nearest unvisited point from the k-d tree
+    nearest_neighbour_reorder(tour.data(), ncities, [&vrp](node_t v) { return vrp.node[v].x; },
+                              [&vrp](node_t v) { return vrp.node[v].y; });
+    return;
+  }
+
   for (i = 1; i < ncities; i++) {
     weight_t ThisX = vrp.node[tour[i - 1]].x;
     weight_t ThisY = vrp.node[tour[i - 1]].y;
@@ -423,140 +659,47 @@ void tsp_approx(const VRP &vrp, std::vector<node_t> &cities, std::vector<node_t>
   }
 }
 
-std::vector<std::vector<node_t>>
-postprocess_tsp_approx(const VRP &vrp, std::vector<std::vector<node_t>> &solRoutes) {
-  std::vector<std::vector<node_t>> modifiedRoutes;
+// Nearest neighbour reordering of one route, starting from the depot
+std::vector<node_t> route_tsp_approx(const VRP &vrp, const std::vector<node_t> &route) {
+  unsigned sz = route.size();
+  std::vector<node_t> cities(sz + 1);
+  std::vector<node_t> tour(sz + 1);
 
-  unsigned nroutes = solRoutes.size();
-  for (unsigned i = 0; i < nroutes; ++i) {
-    // postprocessing solRoutes[i]
-    unsigned sz = solRoutes[i].size();
-    std::vector<node_t> cities(sz + 1);
-    std::vector<node_t> tour(sz + 1);
+  for (unsigned j = 0; j < sz; ++j)
+    cities[j] = route[j];
 
-    for (unsigned j = 0; j < sz; ++j)
-      cities[j] = solRoutes[i][j];
+  cities[sz] = 0;  // the last node is the depot.
 
-    cities[sz] = 0;  // the last node is the depot.
-
-    tsp_approx(vrp, cities, tour, sz + 1);
-
-    // the first element of the tour is now the depot. So, ignore tour[0] and insert the rest into the vector.
-
-    vector<node_t> curr_route;
-    for (unsigned kk = 1; kk < sz + 1; ++kk) {
-      curr_route.push_back(tour[kk]);
-    }
+  tsp_approx(vrp, cities, tour, sz + 1);
 
-    modifiedRoutes.push_back(curr_route);
-  }
-  return modifiedRoutes;
+  // the first element of the tour is now the depot. So, ignore tour[0].
+  return std::vector<node_t>(tour.begin() + 1, tour.end());
 }
 
-void tsp_2opt(const VRP &vrp, std::vector<node_t> &cities, std::vector<node_t> &tour, unsigned ncities) {
-  // 'cities' contains the original solution. It is updated during the course of the 2opt-scheme to contain the 2opt soln.
-  // 'tour' is an auxillary array.
-
-  // repeat until no improvement is made
-  unsigned improve = 0;
-
-  while (improve < 2) {
-    double best_distance = 0.0;
-    //~ best_distance += L2_dist(points.x_coords[cities[0]], points.y_coords[cities[0]], 0, 0); // computing distance of the first point in the route with the depot.
-    best_distance += vrp.get_dist(DEPOT, cities[0]);  // computing distance of the first point in the route with the depot.
-
-    for (unsigned jj = 1; jj < ncities; ++jj) {
-      //~ best_distance += L2_dist(points.x_coords[cities[jj-1]], points.y_coords[cities[jj-1]], points.x_coords[cities[jj]], points.y_coords[cities[jj]]);
-      best_distance += vrp.get_dist(cities[jj - 1], cities[jj]);
-    }
-    //~ best_distance += L2_dist(points.x_coords[cities[ncities-1]], points.y_coords[cities[ncities-1]], 0, 0); // computing distance of the last point in the route with the depot.
-    best_distance += vrp.get_dist(DEPOT, cities[ncities - 1]);
-    // 1x 2x 3x 4 5
-    //  1 2  3  4 5
-    for (unsigned i = 0; i < ncities - 1; i++) {
-      for (unsigned k = i + 1; k < ncities; k++) {
-        for (unsigned c = 0; c < i; ++c) {
-          tour[c] = cities[c];
-        }
-
-        unsigned dec = 0;
-        for (unsigned c = i; c < k + 1; ++c) {
-          tour[c] = cities[k - dec];
-          dec++;
-        }
-
-        for (unsigned c = k + 1; c < ncities; ++c) {
-          tour[c] = cities[c];
-        }
-        double new_distance = 0.0;
-        //~ new_distance += L2_dist(points.x_coords[tour[0]], points.y_coords[tour[0]], 0, 0); // computing distance of the first point in the route with the depot.
-        new_distance += vrp.get_dist(DEPOT, tour[0]);
-        for (unsigned jj = 1; jj < ncities; ++jj) {
-          //~ new_distance += L2_dist(points.x_coords[tour[jj-1]], points.y_coords[tour[jj-1]], points.x_coords[tour[jj]], points.y_coords[tour[jj]]);
-          new_distance += vrp.get_dist(tour[jj - 1], tour[jj]);
-        }
-        //~ new_distance += L2_dist(points.x_coords[tour[ncities-1]], points.y_coords[tour[ncities-1]], 0, 0); // computing distance of the last point in the route with the depot.
-        new_distance += vrp.get_dist(DEPOT, tour[ncities - 1]);
-
-        if (new_distance < best_distance) {
-          // Improvement found so reset
-          improve = 0;
-          for (unsigned jj = 0; jj < ncities; jj++)
-            cities[jj] = tour[jj];
-          best_distance = new_distance;
-        }
-      }
-    }
-    improve++;
-  }
+void tsp_2opt(const VRP &vrp, std::vector<node_t> &cities, unsigned ncities) {
+  // 'cities' contains the original solution. It is updated in place to contain the 2opt soln.
+  optimise_route(cities.data(), ncities, (node_t)DEPOT, [&vrp](node_t a, node_t b) { return vrp.get_dist(a, b); },
+                 [&vrp](node_t v) { return vrp.node[v].x; }, [&vrp](node_t v) { return vrp.node[v].y; });
 }
 
-std::vector<std::vector<node_t>>
-postprocess_2OPT(const VRP &vrp, std::vector<std::vector<node_t>> &final_routes) {
-  std::vector<std::vector<node_t>> postprocessed_final_routes;
-
-  unsigned nroutes = final_routes.size();
-  for (unsigned i = 0; i < nroutes; ++i) {
-    // postprocessing final_routes[i]
-    unsigned sz = final_routes[i].size();
-    //~ unsigned* cities = (unsigned*) malloc(sizeof(unsigned) * (sz));
-    //~ unsigned* tour = (unsigned*) malloc(sizeof(unsigned) * (sz));  // this is an auxillary array
-
-    std::vector<node_t> cities(sz);
-    std::vector<node_t> tour(sz);
-
-    for (unsigned j = 0; j < sz; ++j)
-      cities[j] = final_routes[i][j];
-
-    vector<node_t> curr_route;
-
-    if (sz > 2)                         // for sz <= 1, the cost of the path cannot change. So no point running this.
-      tsp_2opt(vrp, cities, tour, sz);  //MAIN
-
-    for (unsigned kk = 0; kk < sz; ++kk) {
-      curr_route.push_back(cities[kk]);
-    }
+// 2-opt (Or-opt too on longer routes) of one route
+std::vector<node_t> route_2opt(const VRP &vrp, std::vector<node_t> route) {
+  if (route.size() > 2)  // for sz <= 2, the cost of the path cannot change. So no point running this.
+    tsp_2opt(vrp, route, route.size());
+  return route;
+}
 
-    postprocessed_final_routes.push_back(curr_route);
-  }
-  return postprocessed_final_routes;
+weight_t get_cost_of_route(const VRP &vrp, const std::vector<node_t> &route) {
+  weight_t cost = vrp.get_dist(DEPOT, route[0]);
+  for (unsigned jj = 1; jj < route.size(); ++jj)
+    cost += vrp.get_dist(route[jj - 1], route[jj]);
+  return cost + vrp.get_dist(DEPOT, route[route.size() - 1]);
 }
 
 weight_t get_total_cost_of_routes(const VRP &vrp, vector<vector<node_t>> &final_routes) {
   weight_t total_cost = 0.0;
-  for (unsigned ii = 0; ii < final_routes.size(); ++ii) {
-    weight_t curr_route_cost = 0;
-    //~ curr_route_cost += L2_dist(points.x_coords[final_routes[ii][0]], points.y_coords[final_routes[ii][0]], 0, 0); // computing distance of the first point in the route with the depot.
-    curr_route_cost += vrp.get_dist(DEPOT, final_routes[ii][0]);
-    for (unsigned jj = 1; jj < final_routes[ii].size(); ++jj) {
-      //~ curr_route_cost += L2_dist(points.x_coords[final_routes[ii][jj-1]], points.y_coords[final_routes[ii][jj-1]], points.x_coords[final_routes[ii][jj]], points.y_coords[final_routes[ii][jj]]);
-      curr_route_cost += vrp.get_dist(final_routes[ii][jj - 1], final_routes[ii][jj]);
-    }
-    //~ curr_route_cost += L2_dist(points.x_coords[final_routes[ii][final_routes[ii].size()-1]], points.y_coords[final_routes[ii][final_routes[ii].size()-1]], 0, 0); // computing distance of the last point in the route with the depot.
-    curr_route_cost += vrp.get_dist(DEPOT, final_routes[ii][final_routes[ii].size() - 1]);
-
-    total_cost += curr_route_cost;
-  }
+  for (unsigned ii = 0; ii < final_routes.size(); ++ii)
+    total_cost += get_cost_of_route(vrp, final_routes[ii]);
 
   return total_cost;
 }
@@ -566,60 +709,22 @@ weight_t get_total_cost_of_routes(const VRP &vrp, vector<vector<node_t>> &final_
 //
 std::vector<std::vector<node_t>>
 postProcessIt(const VRP &vrp, std::vector<std::vector<node_t>> &final_routes, weight_t &minCost) {
-  std::vector<std::vector<node_t>> postprocessed_final_routes;
+  std::vector<std::vector<node_t>> postprocessed_final_routes(final_routes.size());
 
-  auto postprocessed_final_routes1 = postprocess_tsp_approx(vrp, final_routes);
-  auto postprocessed_final_routes2 = postprocess_2OPT(vrp, postprocessed_final_routes1);
-  auto postprocessed_final_routes3 = postprocess_2OPT(vrp, final_routes);
-
-//~ weight_t postprocessed_final_routes_cost;
-#pragma omp parallel for
+  // One task per route: tsp_approx + 2-opt and plain 2-opt, keep the better one in the
+  // route's own slot. Route lengths vary, hence the dynamic schedule.
+#pragma omp parallel for schedule(dynamic)
   for (unsigned zzz = 0; zzz < final_routes.size(); ++zzz) {
-    // include the better route between postprocessed_final_routes2[zzz] and postprocessed_final_routes3[zzz] in the final solution.
-
-    vector<node_t> postprocessed_route2 = postprocessed_final_routes2[zzz];
-    vector<node_t> postprocessed_route3 = postprocessed_final_routes3[zzz];
-
-    unsigned sz2 = postprocessed_route2.size();
-    unsigned sz3 = postprocessed_route3.size();
-
-    // finding the cost of postprocessed_route2
-
-    weight_t postprocessed_route2_cost = 0.0;
-    //~ postprocessed_route2_cost += L2_dist(points.x_coords[postprocessed_route2[0]], points.y_coords[postprocessed_route2[0]], 0, 0); // computing distance of the first point in the route with the depot.
-    postprocessed_route2_cost += vrp.get_dist(DEPOT, postprocessed_route2[0]);  // computing distance of the first point in the route with the depot.
-    for (unsigned jj = 1; jj < sz2; ++jj) {
-      //~ postprocessed_route2_cost += L2_dist(points.x_coords[postprocessed_route2[jj-1]], points.y_coords[postprocessed_route2[jj-1]], points.x_coords[postprocessed_route2[jj]], points.y_coords[postprocessed_route2[jj]]);
-      postprocessed_route2_cost += vrp.get_dist(postprocessed_route2[jj - 1], postprocessed_route2[jj]);
-    }
-    //~ postprocessed_route2_cost += L2_dist(points.x_coords[postprocessed_route2[sz2-1]], points.y_coords[postprocessed_route2[sz2-1]], 0, 0); // computing distance of the last point in the route with the depot.
-    postprocessed_route2_cost += vrp.get_dist(DEPOT, postprocessed_route2[sz2 - 1]);
-
-    // finding the cost of postprocessed_route3
-
-    weight_t postprocessed_route3_cost = 0.0;
-    //~ postprocessed_route3_cost += L2_dist(points.x_coords[postprocessed_route3[0]], points.y_coords[postprocessed_route3[0]], 0, 0); // computing distance of the first point in the route with the depot.
-    postprocessed_route3_cost += vrp.get_dist(DEPOT, postprocessed_route3[0]);
-    for (unsigned jj = 1; jj < sz3; ++jj) {
-      //~ postprocessed_route3_cost += L2_dist(points.x_coords[postprocessed_route3[jj-1]], points.y_coords[postprocessed_route3[jj-1]], points.x_coords[postprocessed_route3[jj]], points.y_coords[postprocessed_route3[jj]]);
-      postprocessed_route3_cost += vrp.get_dist(postprocessed_route3[jj - 1], postprocessed_route3[jj]);
-    }
-    //~ postprocessed_route3_cost += L2_dist(points.x_coords[postprocessed_route3[sz3-1]], points.y_coords[postprocessed_route3[sz3-1]], 0, 0); // computing distance of the last point in the route with the depot.
-    postprocessed_route3_cost += vrp.get_dist(DEPOT, postprocessed_route3[sz3 - 1]);
+    auto postprocessed_route2 = route_2opt(vrp, route_tsp_approx(vrp, final_routes[zzz]));
+    auto postprocessed_route3 = route_2opt(vrp, final_routes[zzz]);
 
-    // postprocessed_route2_cost is lower
-    if (postprocessed_route3_cost > postprocessed_route2_cost) {
-      postprocessed_final_routes.push_back(postprocessed_route2);
-    }
-    // postprocessed_route3_cost is lower
-    else {
-      postprocessed_final_routes.push_back(postprocessed_route3);
-    }
+    if (get_cost_of_route(vrp, postprocessed_route3) > get_cost_of_route(vrp, postprocessed_route2))
+      postprocessed_final_routes[zzz] = std::move(postprocessed_route2);
+    else
+      postprocessed_final_routes[zzz] = std::move(postprocessed_route3);
   }
 
-  auto postprocessed_final_routes_cost = get_total_cost_of_routes(vrp, postprocessed_final_routes);
-
-  minCost = postprocessed_final_routes_cost;
+  minCost = get_total_cost_of_routes(vrp, postprocessed_final_routes);
 
   return postprocessed_final_routes;
 }
@@ -633,7 +738,6 @@ calCost(const VRP &vrp, const std::vector<std::vector<node_t>> &final_routes) {
     weight_t curr_route_cost = 0;
     curr_route_cost += vrp.get_dist(DEPOT, final_routes[ii][0]);
 
-#pragma omp parallel for reduction(+ : curr_route_cost)
     for (unsigned jj = 1; jj < final_routes[ii].size(); ++jj) {
       curr_route_cost += vrp.get_dist(final_routes[ii][jj - 1], final_routes[ii][jj]);
     }
@@ -682,7 +786,7 @@ int main(int argc, char *argv[]) {
   VRP vrp;
   if (argc < 2) {
     std::cout << "parMDS version 1.1" << '\n';
-    std::cout << "Usage: " << argv[0] << " toy.vrp [-nthreads <n> DEFAULT is 20] [-round 0 or 1 DEFAULT:1]" << '\n';
+    std::cout << "Usage: " << argv[0] << " toy.vrp [-nthreads <n> DEFAULT is 20] [-round 0 or 1 DEFAULT:1] [-knn <k> DEFAULT:0 means complete graph] [-mst prim, delaunay or boruvka DEFAULT:prim] [-seed <s> DEFAULT:0] [-prune 0, 1 or 2 DEFAULT:1] [-split greedy or optimal DEFAULT:greedy]" << '\n';
     exit(1);
   }
 
@@ -691,9 +795,19 @@ int main(int argc, char *argv[]) {
       vrp.params.toRound = atoi(argv[ii + 1]);
     else if (std::string(argv[ii]) == "-nthreads")
       vrp.params.nThreads = atoi(argv[ii + 1]);
+    else if (std::string(argv[ii]) == "-knn")
+      vrp.params.kNN = atoi(argv[ii + 1]);
+    else if (std::string(argv[ii]) == "-mst" && (std::string(argv[ii + 1]) == "prim" || std::string(argv[ii + 1]) == "delaunay" || std::string(argv[ii + 1]) == "boruvka"))
+      vrp.params.mst = argv[ii + 1];
+    else if (std::string(argv[ii]) == "-seed")
+      vrp.params.seed = strtoul(argv[ii + 1], nullptr, 10);
+    else if (std::string(argv[ii]) == "-prune" && atoi(argv[ii + 1]) >= 0 && atoi(argv[ii + 1]) <= 2)
+      vrp.params.prune = atoi(argv[ii + 1]);
+    else if (std::string(argv[ii]) == "-split" && (std::string(argv[ii + 1]) == "greedy" || std::string(argv[ii + 1]) == "optimal"))
+      vrp.params.split = argv[ii + 1];
     else {
       std::cerr << "INVALID Arguments!" << '\n';
-      std::cerr << "Usage:" << argv[0] << " toy.vrp -nthreads 20 -round 1" << '\n';
+      std::cerr << "Usage:" << argv[0] << " toy.vrp -nthreads 20 -round 1 -knn 0 -mst prim -seed 0 -prune 1 -split greedy" << '\n';
       exit(1);
     }
   }
@@ -707,38 +821,54 @@ int main(int argc, char *argv[]) {
   std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
 
   //~ vrp.print();
-  auto cG = vrp.cal_graph_dist();  // complete graph.
+  std::vector<std::vector<Edge>> mstG;
+  if (vrp.params.mst == "delaunay") {
+    mstG = DelaunayMST(vrp);  // no candidate graph and no distance table
+  } else if (vrp.params.mst == "boruvka") {
+    mstG = BoruvkaMST(vrp);
+  } else {
+    // complete graph, or the sparse kNN candidate graph for large instances.
+    auto cG = (vrp.params.kNN > 0 ? vrp.cal_graph_knn() : vrp.cal_graph_dist());
 
-  //~ vrp.print_dist();
-  auto mstG = PrimsAlgo(vrp, cG);
+    //~ vrp.print_dist();
+    mstG = PrimsAlgo(vrp, cG);
+  }
 
   //~ printAdjList(mstG);
 
-  std::vector<bool> visited(mstG.size(), false);
-  visited[0] = true;
-  std::vector<int> singleRoute;
-
   weight_t minCost = INT_MAX * 1.0f;
   std::vector<std::vector<node_t>> minRoute;
 
   // Okay! as it happens only once.
   auto mstCopy = mstG;
 
-  for (int i = 0; i < 1; i++) {
-    // RANDOMIZE THE ADJ LIST OF MST
-    for (auto &list : mstCopy) {                                              //& indicates the exiting mst list will be modified and subsequent Shortcircuit computation
-      std::shuffle(list.begin(), list.end(), std::default_random_engine(0));  // rand()
-    }
+  // RANDOMIZE THE ADJ LIST OF MST
+  for (auto &list : mstCopy) {                                              //& indicates the exiting mst list will be modified and subsequent Shortcircuit computation
+    std::shuffle(list.begin(), list.end(), std::default_random_engine(0));  // rand()
+  }
+  // Iterative DFS over the MST packed once; threads copy it and shuffle in place from then on.
+  RandomDFS dfs(mstCopy, [](const Edge &e) { return e.to; });
 
-    std::vector<int> singleRoute;
+  // -split optimal: Prins/Vidal split of every tour instead of the greedy cut. Its prefix
+  // costs say nothing about the final cost, so such tours are walked in full (no -prune).
+  const bool optimalSplit = (vrp.params.split == "optimal");
+  auto distFn = [&vrp](node_t a, node_t b) { return vrp.get_dist(a, b); };
+  auto demandFn = [&vrp](node_t v) { return vrp.node[v].demand; };
 
-    std::vector<bool> visited(mstCopy.size(), false);
-    visited[0] = true;
+  for (int i = 0; i < 1; i++) {
 
-    ShortCircutTour(mstCopy, visited, 0, singleRoute);  //a DFS //Write singleRoute
+    const auto &singleRoute = dfs.tour(0);  //a DFS
     DEBUG std::cout << '\n';
 
-    auto aRoutes = convertToVrpRoutes(vrp, singleRoute);
+    std::vector<std::vector<node_t>> aRoutes;
+    if (optimalSplit) {
+      LinearSplit linear;
+      if (std::isfinite(linear.run(singleRoute.data(), singleRoute.size(), DEPOT, vrp.getCapacity(), distFn, demandFn)))
+        linear.routes(aRoutes);
+      else  // no feasible split: fall back to the greedy cut
+        aRoutes = convertToVrpRoutes(vrp, singleRoute);
+    } else
+      aRoutes = convertToVrpRoutes(vrp, singleRoute);
 
     //~ std::vector< std::vector<float>> aRoutes={{1,4},{3,2,5}};
     auto aCostRoute = calCost(vrp, aRoutes);
@@ -759,32 +889,84 @@ int main(int argc, char *argv[]) {
   //~ short PARLIMIT = ((argc == 3) ? stoi(argv[2]) : 20);  //Default stride is 20 if arg 3 is not provided!
   short PARLIMIT = vrp.params.nThreads;
 
-#pragma omp parallel for shared(minCost, minRoute) num_threads(PARLIMIT)
-  for (int i = 0; i < 100000; i += PARLIMIT) {                                     // 10^5 is chosen empirically beyond which the solution quality improves very merge amount!
-    for (auto &list : mstCopy) {                                                   //& indicates the exiting mst list will be modified and subsequent Shortcircuit computation
-      std::shuffle(list.begin(), list.end(), std::default_random_engine(rand()));  //seed | i | rand()  // DEFAULT is rand
-    }
-
-    //reset
-    //~ singleRoute.clear();
-    std::vector<int> singleRoute;
-
-    std::vector<bool> visited(mstCopy.size(), false);
-    visited[0] = true;
-
-    ShortCircutTour(mstCopy, visited, 0, singleRoute);  //a DFS //Write singleRoute
-    DEBUG std::cout << '\n';
+  // Every thread explores with its own copy of the MST DFS and its own incumbent. Iteration i
+  // draws from SplitMix64(seed, i) alone, so only the (cost, i) of each thread's best is kept;
+  // the winner is merged once at the end and its routes rebuilt by replaying i. Ties go to the
+  // earliest iteration, so a run is reproducible for a given -seed and -nthreads.
+  // With -prune a tour is abandoned once its partial cost (or lower bound) can no longer beat the
+  // thread's own best, nor tie the best published by any thread; the winner is unchanged.
+  int minIter = -1;  // iteration that found minRoute, -1 is the Step 1 tour
+  std::atomic<weight_t> sharedCost(minCost);
+  TailBound tb;
+  if (vrp.params.prune == 2)
+    tb = calTailBound(vrp);
+#pragma omp parallel num_threads(PARLIMIT)
+  {
+    RandomDFS myDfs = dfs;
+    SplitCost split(vrp, vrp.params.prune == 2 ? &tb : nullptr);
+    const bool prune = vrp.params.prune > 0;
+    LinearSplit linear;
+    std::vector<node_t> myTour;
+    myTour.reserve(myDfs.size());
+
+    weight_t myCost = minCost;
+    int myIter = -1;
+
+#pragma omp for schedule(static)
+    for (int i = 0; i < 100000; i += PARLIMIT) {  // 10^5 is chosen empirically beyond which the solution quality improves very merge amount!
+      // A stream of its own per iteration, never carried over: a pruned shuffled_walk stops
+      // drawing at a point that depends on sharedCut, i.e. on the other threads.
+      SplitMix64 rng(vrp.params.seed, i);
+      weight_t aCost;
+      if (optimalSplit) {
+        myTour.clear();
+        myDfs.shuffled_walk(0, rng, [&myTour](node_t v) { myTour.push_back(v); return true; });  //a DFS
+        aCost = linear.run(myTour.data(), myTour.size(), DEPOT, vrp.getCapacity(), distFn, demandFn);  // +inf if infeasible
+      } else {
+        split.reset();
+        weight_t sharedCut = sharedCost.load(std::memory_order_relaxed);
+        bool done = myDfs.shuffled_walk(0, rng, [&](node_t v) {  //a DFS, split and costed on the fly
+          split.add(v);
+          return !prune || (split.lower() < myCost && split.lower() <= sharedCut);
+        });
+        if (!done)
+          continue;
+        aCost = split.finish();
+      }
 
-    auto aRoutes = convertToVrpRoutes(vrp, singleRoute);
+      if (aCost < myCost) {
+        myCost = aCost;
+        myIter = i;
+        weight_t seen = sharedCost.load(std::memory_order_relaxed);
+        while (myCost < seen && !sharedCost.compare_exchange_weak(seen, myCost, std::memory_order_relaxed)) {
+        }
+      }
+    }
 
-    //~ std::vector< std::vector<float>> aRoutes={{1,4},{3,2,5}};
-    auto aCostRoute = calCost(vrp, aRoutes);
-    if (aCostRoute.first < minCost) {
-      minCost = aCostRoute.first;
-      minRoute = aCostRoute.second;
+#pragma omp critical
+    {
+      if (myIter >= 0 && (myCost < minCost || (myCost == minCost && myIter < minIter))) {
+        minCost = myCost;
+        minIter = myIter;
+      }
     }
   }
 
+  // Replay the winning iteration, the only time routes are built in the loop above.
+  if (minIter >= 0) {
+    SplitMix64 rng(vrp.params.seed, minIter);
+    dfs.shuffled_walk(0, rng, [](node_t) { return true; });
+    const auto &bestTour = dfs.tour(0);
+    if (optimalSplit) {
+      LinearSplit linear;
+      if (std::isfinite(linear.run(bestTour.data(), bestTour.size(), DEPOT, vrp.getCapacity(), distFn, demandFn)))
+        linear.routes(minRoute);
+      else
+        minRoute = convertToVrpRoutes(vrp, bestTour);
+    } else
+      minRoute = convertToVrpRoutes(vrp, bestTour);
+  }
+
   //// UPTO2
   //   END TIMER
   auto minCost2 = minCost;